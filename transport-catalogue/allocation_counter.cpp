@@ -0,0 +1,33 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace diagnostics {
+
+    namespace {
+        thread_local size_t thread_allocations = 0;
+    }
+
+    size_t GetThreadAllocationCount() {
+        return thread_allocations;
+    }
+
+}
+
+// Остальные формы operator new стандартной библиотеки вызывают эту
+void* operator new(std::size_t size) {
+    ++diagnostics::thread_allocations;
+    if (void* ptr = std::malloc(size != 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+// Счётчик выделений памяти через глобальный operator new. Счётчик свой у каждого
+// потока, поэтому разность двух показаний относится только к коду между ними
+namespace diagnostics {
+
+    // Сколько раз текущий поток выделял память с начала работы
+    size_t GetThreadAllocationCount();
+
+}
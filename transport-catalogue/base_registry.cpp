@@ -0,0 +1,146 @@
+#include "base_registry.h"
+
+namespace transport_catalogue {
+
+    BaseRegistry::BaseRegistry(TenancySettings settings, Loader loader)
+        : settings_(std::move(settings))
+        , loader_(std::move(loader)) {
+        for (const auto& [name, file] : settings_.bases) {
+            bases_[name].file = file;
+        }
+    }
+
+    std::shared_ptr<const CatalogueSnapshot> BaseRegistry::Acquire(const std::string& name) {
+        std::lock_guard guard(mutex_);
+        auto it = bases_.find(name);
+        if (it == bases_.end()) {
+            return nullptr;
+        }
+        Base& base = it->second;
+        if (!base.catalogue) {
+            Load(base);
+        }
+        if (!base.snapshot) {
+            BuildRouter(base);
+        }
+        Touch(name, base);
+        UpdateCacheBytes();
+        EnforceBudget(name);
+        return base.snapshot;
+    }
+
+    BaseRegistry::Metrics BaseRegistry::GetMetrics() {
+        std::lock_guard guard(mutex_);
+        UpdateCacheBytes();
+        return metrics_;
+    }
+
+    void BaseRegistry::Load(Base& base) {
+        const auto start = Clock::now();
+        LoadedBase loaded = loader_(base.file);
+        base.catalogue = std::make_shared<const catalogue::TransportCatalogue>(std::move(loaded.catalogue));
+        base.renderer = std::make_shared<const renderer::MapRenderer>(std::move(loaded.renderer));
+        base.routing_settings = loaded.routing_settings;
+        base.routes = std::move(loaded.routes);
+        // Карта рисуется не больше одного раза за загрузку, а не на каждый запрос Map
+        base.map = MakeLazyMap(base.catalogue, base.renderer, std::move(loaded.map));
+        base.catalogue_bytes = base.catalogue->EstimateMemoryUsage();
+        metrics_.resident_bytes += base.catalogue_bytes;
+
+        const double elapsed = ElapsedMs(start);
+        ++metrics_.loads;
+        if (base.was_loaded) {
+            ++metrics_.reloads;
+        }
+        base.was_loaded = true;
+        metrics_.load_time_ms += elapsed;
+        metrics_.max_load_time_ms = std::max(metrics_.max_load_time_ms, elapsed);
+    }
+
+    void BaseRegistry::BuildRouter(Base& base) {
+        const auto start = Clock::now();
+        auto router = std::make_shared<const TransportRouter>(*base.catalogue, base.routing_settings, base.routes);
+        base.router_bytes = router->EstimateMemoryUsage();
+        metrics_.resident_bytes += base.router_bytes;
+        base.snapshot = std::make_shared<const CatalogueSnapshot>(++base.version, base.catalogue, base.renderer, std::move(router),
+            base.map);
+        ++metrics_.router_builds;
+        metrics_.router_build_time_ms += ElapsedMs(start);
+    }
+
+    void BaseRegistry::EvictRouter(Base& base) {
+        // Снимок — единственный владелец маршрутизатора, если его не удерживает выполняющийся запрос
+        const auto start = Clock::now();
+        base.snapshot.reset();
+        metrics_.resident_bytes -= base.router_bytes + base.cache_bytes;
+        base.router_bytes = 0;
+        base.cache_bytes = 0;
+        ++metrics_.router_evictions;
+        metrics_.eviction_time_ms += ElapsedMs(start);
+    }
+
+    void BaseRegistry::Evict(Base& base) {
+        if (base.snapshot) {
+            EvictRouter(base);
+        }
+        const auto start = Clock::now();
+        base.catalogue.reset();
+        base.renderer.reset();
+        base.routes.reset();
+        base.map.reset();
+        metrics_.resident_bytes -= base.catalogue_bytes + base.map_bytes;
+        base.catalogue_bytes = 0;
+        base.map_bytes = 0;
+        lru_.erase(base.lru_pos);
+        base.resident = false;
+        ++metrics_.evictions;
+        metrics_.eviction_time_ms += ElapsedMs(start);
+    }
+
+    void BaseRegistry::UpdateCacheBytes() {
+        // Карта и кеши строятся во время запросов, поэтому их объём пересчитывается при каждом обращении
+        for (const std::string& name : lru_) {
+            Base& base = bases_.at(name);
+            if (const RenderedMap* map = base.map->TryGet()) {
+                const size_t bytes = map->Get().capacity() + map->GetLiteral().size();
+                metrics_.resident_bytes = metrics_.resident_bytes - base.map_bytes + bytes;
+                base.map_bytes = bytes;
+            }
+            if (base.snapshot) {
+                const size_t bytes = base.snapshot->EstimateCacheMemoryUsage();
+                metrics_.resident_bytes = metrics_.resident_bytes - base.cache_bytes + bytes;
+                base.cache_bytes = bytes;
+            }
+        }
+    }
+
+    void BaseRegistry::EnforceBudget(const std::string& keep) {
+        // Таблицы маршрутизации занимают квадратичную от числа остановок память,
+        // поэтому сначала освобождаем их, и лишь затем выгружаем базы целиком
+        for (auto it = lru_.rbegin(); it != lru_.rend() && metrics_.resident_bytes > settings_.memory_budget; ++it) {
+            Base& base = bases_.at(*it);
+            if (*it != keep && base.snapshot) {
+                EvictRouter(base);
+            }
+        }
+        while (metrics_.resident_bytes > settings_.memory_budget && lru_.size() > 1) {
+            const std::string& coldest = lru_.back() != keep ? lru_.back() : *std::next(lru_.rbegin());
+            Evict(bases_.at(coldest));
+        }
+    }
+
+    void BaseRegistry::Touch(const std::string& name, Base& base) {
+        if (base.resident) {
+            lru_.splice(lru_.begin(), lru_, base.lru_pos);
+        }
+        else {
+            lru_.push_front(name);
+            base.lru_pos = lru_.begin();
+            base.resident = true;
+        }
+    }
+
+    double BaseRegistry::ElapsedMs(Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "catalogue_snapshot.h"
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace transport_catalogue {
+
+    struct TenancySettings {
+        // memory_budget — допустимый суммарный объём загруженных баз, в байтах
+        size_t memory_budget = std::numeric_limits<size_t>::max();
+        // bases — имя базы и файл, из которого она загружается при первом обращении
+        std::map<std::string, std::string> bases;
+        // report_metrics — выводить ли метрики загрузки и вытеснения в stderr
+        bool report_metrics = false;
+    };
+
+    // Хранит несколько именованных баз в одном процессе. База загружается при первом
+    // запросе к ней; при превышении бюджета памяти у давно не использовавшихся баз
+    // сначала вытесняются таблицы маршрутизации, затем базы целиком
+    class BaseRegistry {
+    public:
+        struct LoadedBase {
+            catalogue::TransportCatalogue catalogue;
+            renderer::MapRenderer renderer;
+            RoutingSettings routing_settings;
+            // Таблицы маршрутизатора, сохранённые вместе с базой, если они есть
+            std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes;
+            // Карта, сохранённая вместе с базой, если она есть
+            std::shared_ptr<const RenderedMap> map;
+        };
+
+        using Loader = std::function<LoadedBase(const std::string& file)>;
+
+        struct Metrics {
+            size_t loads = 0;
+            size_t reloads = 0;
+            size_t router_builds = 0;
+            size_t evictions = 0;
+            size_t router_evictions = 0;
+            double load_time_ms = 0;
+            double max_load_time_ms = 0;
+            double router_build_time_ms = 0;
+            double eviction_time_ms = 0;
+            size_t resident_bytes = 0;
+        };
+
+        BaseRegistry(TenancySettings settings, Loader loader);
+
+        // Возвращает снимок базы, при необходимости загрузив её. Для неизвестного имени — nullptr.
+        // Снимок остаётся действительным, даже если база будет вытеснена во время его использования
+        std::shared_ptr<const CatalogueSnapshot> Acquire(const std::string& name);
+
+        // Объём кешей снимков пересчитывается на момент вызова
+        Metrics GetMetrics();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Base {
+            std::string file;
+            bool was_loaded = false;
+            std::shared_ptr<const catalogue::TransportCatalogue> catalogue;
+            std::shared_ptr<const renderer::MapRenderer> renderer;
+            RoutingSettings routing_settings;
+            std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes;
+            // Карта рисуется при первом запросе и переживает вытеснение маршрутизатора:
+            // она зависит только от справочника
+            std::shared_ptr<const LazyMap> map;
+            std::shared_ptr<const CatalogueSnapshot> snapshot;
+            size_t catalogue_bytes = 0;
+            size_t router_bytes = 0;
+            // Карта, если она уже нарисована
+            size_t map_bytes = 0;
+            // Статистика, плитки и сцены карт маршрутов, которые снимок достраивает по мере запросов
+            size_t cache_bytes = 0;
+            uint64_t version = 0;
+            bool resident = false;
+            std::list<std::string>::iterator lru_pos;
+        };
+
+        void Load(Base& base);
+        void BuildRouter(Base& base);
+        void EvictRouter(Base& base);
+        void Evict(Base& base);
+        void UpdateCacheBytes();
+        void EnforceBudget(const std::string& keep);
+        void Touch(const std::string& name, Base& base);
+
+        static double ElapsedMs(Clock::time_point since);
+
+        TenancySettings settings_;
+        Loader loader_;
+        std::map<std::string, Base> bases_;
+        // Загруженные базы от самой свежей к самой давней
+        std::list<std::string> lru_;
+        Metrics metrics_;
+        mutable std::mutex mutex_;
+    };
+}
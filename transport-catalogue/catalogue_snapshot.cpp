@@ -0,0 +1,75 @@
+#include "catalogue_snapshot.h"
+
+#include <chrono>
+
+namespace transport_catalogue {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        double ElapsedMs(Clock::time_point since) {
+            return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+        }
+    }
+
+    std::shared_ptr<const LazyMap> MakeLazyMap(std::shared_ptr<const catalogue::TransportCatalogue> catalogue,
+        std::shared_ptr<const renderer::MapRenderer> renderer, std::shared_ptr<const RenderedMap> stored) {
+        if (stored) {
+            return std::make_shared<const LazyMap>(std::move(stored));
+        }
+        return std::make_shared<const LazyMap>([catalogue = std::move(catalogue), renderer = std::move(renderer)] {
+            return RequestHandler::RenderPreparedMap(*catalogue, *renderer);
+        });
+    }
+
+    size_t CatalogueSnapshot::EstimateCacheMemoryUsage() const {
+        size_t bytes = tiles.EstimateMemoryUsage() + route_maps.EstimateMemoryUsage();
+        if (const BusStats* stats = bus_stats.TryGet()) {
+            // Узел хеш-таблицы: значение, указатель на следующий узел и корзина
+            bytes += stats->size() * (sizeof(BusStats::value_type) + 2 * sizeof(void*));
+        }
+        return bytes;
+    }
+
+    std::shared_ptr<const CatalogueSnapshot> BuildSnapshot(uint64_t version, std::shared_ptr<const catalogue::TransportCatalogue> catalogue,
+        std::shared_ptr<const renderer::MapRenderer> renderer, RoutingSettings routing_settings, StageTimings* timings,
+        std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes, std::shared_ptr<const RenderedMap> map) {
+        const auto start = Clock::now();
+        auto router = std::make_shared<const TransportRouter>(*catalogue, routing_settings, std::move(routes));
+        if (timings) {
+            timings->emplace_back("router", ElapsedMs(start));
+        }
+        auto lazy_map = MakeLazyMap(catalogue, renderer, std::move(map));
+        return std::make_shared<const CatalogueSnapshot>(version, std::move(catalogue), std::move(renderer),
+            std::move(router), std::move(lazy_map));
+    }
+
+    VersionedCatalogue::VersionedCatalogue(catalogue::TransportCatalogue tc, renderer::MapRenderer renderer, RoutingSettings routing_settings,
+        StageTimings* timings, std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes, std::shared_ptr<const RenderedMap> map)
+        : routing_settings_(routing_settings) {
+        Publish(BuildSnapshot(1, std::make_shared<const catalogue::TransportCatalogue>(std::move(tc)),
+            std::make_shared<const renderer::MapRenderer>(std::move(renderer)), routing_settings_, timings, std::move(routes), std::move(map)));
+    }
+
+    std::shared_ptr<const CatalogueSnapshot> VersionedCatalogue::Acquire() const {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    uint64_t VersionedCatalogue::Update(const std::function<void(catalogue::TransportCatalogue&)>& update) {
+        // Писатели выстраиваются в очередь, чтобы ни одно изменение не потерялось
+        std::lock_guard guard(update_mutex_);
+        const auto base = Acquire();
+
+        // Копия разделяет с базовой версией все таблицы до первого изменения
+        auto tc = std::make_shared<catalogue::TransportCatalogue>(*base->catalogue);
+        update(*tc);
+
+        const uint64_t version = base->version + 1;
+        Publish(BuildSnapshot(version, std::move(tc), base->renderer, routing_settings_));
+        return version;
+    }
+
+    void VersionedCatalogue::Publish(std::shared_ptr<const CatalogueSnapshot> snapshot) {
+        std::atomic_store_explicit(&current_, std::move(snapshot), std::memory_order_release);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace transport_catalogue {
+
+    // Длительности стадий построения базы в миллисекундах, в порядке завершения стадий
+    using StageTimings = std::vector<std::pair<std::string, double>>;
+
+    // Карта справочника, которая рисуется при первом запросе. Непустая stored —
+    // уже нарисованная карта, например сохранённая в файле базы
+    std::shared_ptr<const LazyMap> MakeLazyMap(std::shared_ptr<const catalogue::TransportCatalogue> catalogue,
+        std::shared_ptr<const renderer::MapRenderer> renderer, std::shared_ptr<const RenderedMap> stored = nullptr);
+
+    // Неизменяемая версия базы. Читатель, получивший снимок, пользуется им
+    // сколько угодно долго, даже если за это время опубликованы новые версии
+    struct CatalogueSnapshot {
+        CatalogueSnapshot(uint64_t version_, std::shared_ptr<const catalogue::TransportCatalogue> catalogue_,
+            std::shared_ptr<const renderer::MapRenderer> renderer_, std::shared_ptr<const TransportRouter> router_,
+            std::shared_ptr<const LazyMap> map_)
+            : version(version_)
+            , catalogue(std::move(catalogue_))
+            , renderer(std::move(renderer_))
+            , router(std::move(router_))
+            , bus_stats([catalogue = catalogue] { return std::make_shared<const BusStats>(RequestHandler::ComputeAllBusStats(*catalogue)); })
+            , map(std::move(map_))
+            , tiles(*renderer, catalogue->GetAllBuses())
+            , route_maps(*renderer, catalogue->GetAllBuses())
+            , handler(*catalogue, *renderer, *router, &bus_stats, map.get(), &tiles, &route_maps) {
+        }
+
+        // Приблизительный объём памяти, которую снимок достраивает по мере запросов:
+        // статистики маршрутов, плиток и сцены карт маршрутов. Карта в него не входит
+        size_t EstimateCacheMemoryUsage() const;
+
+        uint64_t version;
+        std::shared_ptr<const catalogue::TransportCatalogue> catalogue;
+        std::shared_ptr<const renderer::MapRenderer> renderer;
+        std::shared_ptr<const TransportRouter> router;
+        // Статистика всех маршрутов считается при первом запросе Bus
+        LazyBusStats bus_stats;
+        // Карта рисуется не больше одного раза на версию базы и разделяется всеми запросами Map
+        std::shared_ptr<const LazyMap> map;
+        // Плитки рисуются по запросу и кешируются до конца жизни снимка
+        renderer::MapTiles tiles;
+        // Маршруты запросов RouteMap рисуются поверх map
+        renderer::RouteMaps route_maps;
+        RequestHandler handler;
+    };
+
+    // Строит маршрутизатор; статистика маршрутов и карта считаются при первом запросе.
+    // Если timings задан, в него добавляется длительность стадии router. Подходящие
+    // к справочнику routes избавляют от построения таблиц маршрутизатора, а готовая
+    // map — от отрисовки карты
+    std::shared_ptr<const CatalogueSnapshot> BuildSnapshot(uint64_t version, std::shared_ptr<const catalogue::TransportCatalogue> catalogue,
+        std::shared_ptr<const renderer::MapRenderer> renderer, RoutingSettings routing_settings, StageTimings* timings = nullptr,
+        std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes = nullptr, std::shared_ptr<const RenderedMap> map = nullptr);
+
+    // Хранит текущую версию базы. Читатели никогда не блокируются: Acquire атомарно
+    // копирует указатель на снимок. Изменения применяются к копии справочника,
+    // которая разделяет с предыдущей версией все незатронутые данные
+    class VersionedCatalogue {
+    public:
+        // routes и map используются только для первой версии: изменения справочника меняют граф и карту
+        VersionedCatalogue(catalogue::TransportCatalogue tc, renderer::MapRenderer renderer, RoutingSettings routing_settings,
+            StageTimings* timings = nullptr, std::shared_ptr<const TransportRouter::PrecomputedRoutes> routes = nullptr,
+            std::shared_ptr<const RenderedMap> map = nullptr);
+
+        std::shared_ptr<const CatalogueSnapshot> Acquire() const;
+
+        // Применяет update к новой версии справочника, перестраивает маршрутизатор
+        // и публикует результат. Возвращает номер опубликованной версии
+        uint64_t Update(const std::function<void(catalogue::TransportCatalogue&)>& update);
+
+    private:
+        void Publish(std::shared_ptr<const CatalogueSnapshot> snapshot);
+
+        std::shared_ptr<const CatalogueSnapshot> current_;
+        RoutingSettings routing_settings_;
+        std::mutex update_mutex_;
+    };
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace io {
+
+    // 64-битная FNV-1a. Не криптографическая: защищает только от случайного
+    // несовпадения данных, например файлов от разных сборок базы
+    class Checksum {
+    public:
+        void Add(const void* data, size_t size) {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                value_ = (value_ ^ bytes[i]) * PRIME;
+            }
+        }
+
+        void Add(std::string_view data) {
+            Add(static_cast<uint64_t>(data.size()));
+            Add(data.data(), data.size());
+        }
+
+        template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+        void Add(T value) {
+            Add(&value, sizeof(value));
+        }
+
+        uint64_t Get() const {
+            return value_;
+        }
+
+    private:
+        static constexpr uint64_t OFFSET_BASIS = 14695981039346656037ull;
+        static constexpr uint64_t PRIME = 1099511628211ull;
+
+        uint64_t value_ = OFFSET_BASIS;
+    };
+
+}
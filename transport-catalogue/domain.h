@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <iterator>
 #include <string>
 #include <vector>
 #include "geo.h"
@@ -12,10 +14,81 @@ namespace transport_catalogue {
 
     };
 
+    // Полный проход по маршруту автобуса. Для некольцевого маршрута хранится только
+    // прямое направление, обратное достраивается при итерации: A B C -> A B C B A
+    class BusRoute {
+    public:
+        class Iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = const Stop*;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = value_type;
+
+            Iterator() = default;
+            Iterator(const std::vector<const Stop*>* stops, size_t pos) : stops_(stops), pos_(pos) {}
+
+            reference operator*() const {
+                return pos_ < stops_->size() ? (*stops_)[pos_] : (*stops_)[2 * stops_->size() - 2 - pos_];
+            }
+            reference operator[](difference_type n) const {
+                return *(*this + n);
+            }
+
+            Iterator& operator++() { ++pos_; return *this; }
+            Iterator operator++(int) { Iterator tmp = *this; ++pos_; return tmp; }
+            Iterator& operator--() { --pos_; return *this; }
+            Iterator operator--(int) { Iterator tmp = *this; --pos_; return tmp; }
+            Iterator& operator+=(difference_type n) { pos_ += n; return *this; }
+            Iterator& operator-=(difference_type n) { pos_ -= n; return *this; }
+            Iterator operator+(difference_type n) const { return Iterator(stops_, pos_ + n); }
+            Iterator operator-(difference_type n) const { return Iterator(stops_, pos_ - n); }
+            difference_type operator-(const Iterator& other) const {
+                return static_cast<difference_type>(pos_) - static_cast<difference_type>(other.pos_);
+            }
+
+            bool operator==(const Iterator& other) const { return pos_ == other.pos_; }
+            bool operator!=(const Iterator& other) const { return pos_ != other.pos_; }
+            bool operator<(const Iterator& other) const { return pos_ < other.pos_; }
+            bool operator>(const Iterator& other) const { return pos_ > other.pos_; }
+            bool operator<=(const Iterator& other) const { return pos_ <= other.pos_; }
+            bool operator>=(const Iterator& other) const { return pos_ >= other.pos_; }
+
+        private:
+            const std::vector<const Stop*>* stops_ = nullptr;
+            size_t pos_ = 0;
+        };
+
+        BusRoute(const std::vector<const Stop*>& stops, bool is_loop)
+            : stops_(&stops)
+            , size_(is_loop || stops.empty() ? stops.size() : 2 * stops.size() - 1) {
+        }
+
+        Iterator begin() const { return Iterator(stops_, 0); }
+        Iterator end() const { return Iterator(stops_, size_); }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const Stop* operator[](size_t pos) const { return begin()[pos]; }
+
+    private:
+        const std::vector<const Stop*>* stops_;
+        size_t size_;
+    };
+
     struct Bus {
         bool is_exists = true;
         std::string name;
-        bool is_loop;
+        bool is_loop = false;
+        // Для некольцевого маршрута — только прямое направление, полный проход даёт GetRoute()
         std::vector<const Stop*> stops;
+
+        BusRoute GetRoute() const {
+            return BusRoute(stops, is_loop);
+        }
     };
+
+    inline BusRoute::Iterator operator+(std::ptrdiff_t n, const BusRoute::Iterator& it) {
+        return it + n;
+    }
 }
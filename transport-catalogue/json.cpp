@@ -1,351 +1,760 @@
 #include "json.h"
 
+#include <charconv>
+#include <cstring>
+#include <cstdio>
 #include <iterator>
+#include <string_view>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define JSON_SIMD_SCAN 1
+#endif
 
 namespace json {
 
 namespace {
 using namespace std::literals;
 
-Node LoadNode(std::istream& input);
-Node LoadString(std::istream& input);
+bool IsDigit(int c) {
+    return c >= '0' && c <= '9';
+}
 
-std::string LoadLiteral(std::istream& input) {
-    std::string s;
-    while (std::isalpha(input.peek())) {
-        s.push_back(static_cast<char>(input.get()));
-    }
-    return s;
+bool IsAlpha(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
-Node LoadArray(std::istream& input) {
-    std::vector<Node> result;
+// Те же символы, что пропускает operator>> при чтении char
+bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
 
-    for (char c; input >> c && c != ']';) {
-        if (c != ',') {
-            input.putback(c);
+#ifdef JSON_SIMD_SCAN
+// Битовая маска байтов блока из 16 байт, равных одному из символов
+inline int MatchMask(__m128i chunk, char c0, char c1, char c2, char c3) {
+    const __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c0)), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c1))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c2)), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c3))));
+    return _mm_movemask_epi8(eq);
+}
+#endif
+
+// Первый символ строки, требующий особой обработки: кавычка, \ или перевод строки
+const char* FindStringSpecial(const char* pos, const char* end) {
+#ifdef JSON_SIMD_SCAN
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        if (const int mask = MatchMask(chunk, '"', '\\', '\n', '\r')) {
+            return pos + __builtin_ctz(static_cast<unsigned>(mask));
         }
-        result.push_back(LoadNode(input));
     }
-    if (!input) {
-        throw ParsingError("Array parsing error"s);
+#endif
+    while (pos != end && *pos != '"' && *pos != '\\' && *pos != '\n' && *pos != '\r') {
+        ++pos;
+    }
+    return pos;
+}
+
+const char* SkipSpaces(const char* pos, const char* end) {
+    while (true) {
+#ifdef JSON_SIMD_SCAN
+        for (; end - pos >= 16; pos += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+            if (const int mask = ~MatchMask(chunk, ' ', '\n', '\r', '\t') & 0xFFFF) {
+                pos += __builtin_ctz(static_cast<unsigned>(mask));
+                break;
+            }
+        }
+#endif
+        if (pos == end || !IsSpace(*pos)) {
+            return pos;
+        }
+        ++pos;
     }
-    return Node(std::move(result));
 }
 
-Node LoadDict(std::istream& input) {
-    Dict dict;
+// Разбирает JSON из буфера, находящегося целиком в памяти, сообщая обработчику
+// о каждом элементе. Грамматика и сообщения об ошибках совпадают с прежним
+// потоковым разбором
+template <typename Handler>
+class Parser {
+public:
+    Parser(std::string_view input, Handler& handler)
+        : pos_(input.data())
+        , end_(input.data() + input.size())
+        , handler_(handler) {
+    }
+
+    void ParseNode() {
+        char c;
+        if (!NextToken(c)) {
+            throw ParsingError("Unexpected EOF"s);
+        }
+        switch (c) {
+            case '[':
+                ParseArray();
+                break;
+            case '{':
+                ParseDict();
+                break;
+            case '"':
+                handler_.Value(LoadString());
+                break;
+            case 't':
+                // Встретив t или f, переходим к попытке парсинга литералов true либо false
+                [[fallthrough]];
+            case 'f':
+                --pos_;
+                handler_.Value(LoadBool());
+                break;
+            case 'n':
+                --pos_;
+                handler_.Value(LoadNull());
+                break;
+            default:
+                --pos_;
+                handler_.Value(LoadNumber());
+                break;
+        }
+    }
+
+private:
+    // Аналог input >> c: пропускает пробельные символы и читает следующий
+    bool NextToken(char& c) {
+        pos_ = SkipSpaces(pos_, end_);
+        if (pos_ == end_) {
+            return false;
+        }
+        c = *pos_++;
+        return true;
+    }
+
+    int Peek() const {
+        return pos_ == end_ ? EOF : static_cast<unsigned char>(*pos_);
+    }
+
+    std::string_view LoadLiteral() {
+        const char* begin = pos_;
+        while (IsAlpha(Peek())) {
+            ++pos_;
+        }
+        return { begin, static_cast<size_t>(pos_ - begin) };
+    }
+
+    void ParseArray() {
+        handler_.StartArray();
+
+        char c;
+        bool closed = false;
+        while (NextToken(c)) {
+            if (c == ']') {
+                closed = true;
+                break;
+            }
+            if (c != ',') {
+                --pos_;
+            }
+            ParseNode();
+        }
+        if (!closed) {
+            throw ParsingError("Array parsing error"s);
+        }
+        handler_.EndArray();
+    }
+
+    void ParseDict() {
+        handler_.StartDict();
+
+        char c;
+        bool closed = false;
+        while (NextToken(c)) {
+            if (c == '}') {
+                closed = true;
+                break;
+            }
+            if (c == '"') {
+                std::string key = LoadString();
+                if (NextToken(c) && c == ':') {
+                    handler_.Key(std::move(key));
+                    ParseNode();
+                } else {
+                    throw ParsingError(": is expected but '"s + c + "' has been found"s);
+                }
+            } else if (c != ',') {
+                throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
+            }
+        }
+        if (!closed) {
+            throw ParsingError("Dictionary parsing error"s);
+        }
+        handler_.EndDict();
+    }
 
-    for (char c; input >> c && c != '}';) {
-        if (c == '"') {
-            std::string key = LoadString(input).AsString();
-            if (input >> c && c == ':') {
-                if (dict.find(key) != dict.end()) {
-                    throw ParsingError("Duplicate key '"s + key + "' have been found");
+    std::string LoadString() {
+        std::string s;
+        while (true) {
+            // Участок без экранирования добавляется в строку целиком
+            const char* special = FindStringSpecial(pos_, end_);
+            s.append(pos_, special);
+            pos_ = special;
+            if (pos_ == end_) {
+                throw ParsingError("String parsing error");
+            }
+            const char ch = *pos_++;
+            if (ch == '"') {
+                break;
+            } else if (ch == '\\') {
+                if (pos_ == end_) {
+                    throw ParsingError("String parsing error");
+                }
+                const char escaped_char = *pos_++;
+                switch (escaped_char) {
+                    case 'n':
+                        s.push_back('\n');
+                        break;
+                    case 't':
+                        s.push_back('\t');
+                        break;
+                    case 'r':
+                        s.push_back('\r');
+                        break;
+                    case '"':
+                        s.push_back('"');
+                        break;
+                    case '\\':
+                        s.push_back('\\');
+                        break;
+                    default:
+                        throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
                 }
-                dict.emplace(std::move(key), LoadNode(input));
             } else {
-                throw ParsingError(": is expected but '"s + c + "' has been found"s);
+                throw ParsingError("Unexpected end of line"s);
             }
-        } else if (c != ',') {
-            throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
         }
+        return s;
     }
-    if (!input) {
-        throw ParsingError("Dictionary parsing error"s);
+
+    bool LoadBool() {
+        const auto s = LoadLiteral();
+        if (s == "true"sv) {
+            return true;
+        } else if (s == "false"sv) {
+            return false;
+        } else {
+            throw ParsingError("Failed to parse '"s + std::string(s) + "' as bool"s);
+        }
     }
-    return Node(std::move(dict));
-}
 
-Node LoadString(std::istream& input) {
-    auto it = std::istreambuf_iterator<char>(input);
-    auto end = std::istreambuf_iterator<char>();
-    std::string s;
-    while (true) {
-        if (it == end) {
-            throw ParsingError("String parsing error");
+    std::nullptr_t LoadNull() {
+        if (auto literal = LoadLiteral(); literal == "null"sv) {
+            return nullptr;
+        } else {
+            throw ParsingError("Failed to parse '"s + std::string(literal) + "' as null"s);
         }
-        const char ch = *it;
-        if (ch == '"') {
-            ++it;
-            break;
-        } else if (ch == '\\') {
-            ++it;
-            if (it == end) {
-                throw ParsingError("String parsing error");
+    }
+
+    Node::Value LoadNumber() {
+        const char* begin = pos_;
+
+        // Считывает одну или более цифр
+        auto read_digits = [this] {
+            if (!IsDigit(Peek())) {
+                throw ParsingError("A digit is expected"s);
             }
-            const char escaped_char = *(it);
-            switch (escaped_char) {
-                case 'n':
-                    s.push_back('\n');
-                    break;
-                case 't':
-                    s.push_back('\t');
-                    break;
-                case 'r':
-                    s.push_back('\r');
-                    break;
-                case '"':
-                    s.push_back('"');
-                    break;
-                case '\\':
-                    s.push_back('\\');
-                    break;
-                default:
-                    throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+            while (IsDigit(Peek())) {
+                ++pos_;
             }
-        } else if (ch == '\n' || ch == '\r') {
-            throw ParsingError("Unexpected end of line"s);
+        };
+
+        if (Peek() == '-') {
+            ++pos_;
+        }
+        // Парсим целую часть числа
+        if (Peek() == '0') {
+            ++pos_;
+            // После 0 в JSON не могут идти другие цифры
         } else {
-            s.push_back(ch);
+            read_digits();
+        }
+
+        bool is_int = true;
+        // Парсим дробную часть числа
+        if (Peek() == '.') {
+            ++pos_;
+            read_digits();
+            is_int = false;
+        }
+
+        // Парсим экспоненциальную часть числа
+        if (int ch = Peek(); ch == 'e' || ch == 'E') {
+            ++pos_;
+            if (ch = Peek(); ch == '+' || ch == '-') {
+                ++pos_;
+            }
+            read_digits();
+            is_int = false;
         }
-        ++it;
+
+        if (is_int) {
+            // Сначала пробуем преобразовать строку в int. В случае неудачи,
+            // например, при переполнении, код ниже преобразует строку в double
+            int value;
+            if (const auto [ptr, ec] = std::from_chars(begin, pos_, value); ec == std::errc{} && ptr == pos_) {
+                return value;
+            }
+        }
+        double value;
+        if (const auto [ptr, ec] = std::from_chars(begin, pos_, value); ec == std::errc{} && ptr == pos_) {
+            return value;
+        }
+        throw ParsingError("Failed to convert "s + std::string(begin, pos_) + " to number"s);
     }
 
-    return Node(std::move(s));
-}
+    const char* pos_;
+    const char* end_;
+    Handler& handler_;
+};
 
-Node LoadBool(std::istream& input) {
-    const auto s = LoadLiteral(input);
-    if (s == "true"sv) {
-        return Node{true};
-    } else if (s == "false"sv) {
-        return Node{false};
-    } else {
-        throw ParsingError("Failed to parse '"s + s + "' as bool"s);
+// Выводимые данные копятся в буфере этого размера и передаются потоку крупными блоками
+const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+// Передаёт append строку в кавычках по частям; участки без спецсимволов передаются целиком
+template <typename Append>
+void AppendEscaped(std::string_view value, Append&& append) {
+    append("\""sv);
+    const char* pos = value.data();
+    const char* end = pos + value.size();
+    while (true) {
+        const char* special = FindStringSpecial(pos, end);
+        append({ pos, static_cast<size_t>(special - pos) });
+        if (special == end) {
+            break;
+        }
+        switch (*special) {
+            case '\r':
+                append("\\r"sv);
+                break;
+            case '\n':
+                append("\\n"sv);
+                break;
+            default:
+                // Символы " и \ выводятся как \" или \\, соответственно
+                append("\\"sv);
+                append({ special, 1 });
+                break;
+        }
+        pos = special + 1;
     }
+    append("\""sv);
 }
 
-Node LoadNull(std::istream& input) {
-    if (auto literal = LoadLiteral(input); literal == "null"sv) {
-        return Node{nullptr};
-    } else {
-        throw ParsingError("Failed to parse '"s + literal + "' as null"s);
+const std::string_view INDENT_SPACES = "                                                                "sv;
+
+// Выводит значения в общий буфер вывода; сам буфер и его заполнение принадлежат
+// вызывающему, поэтому Printer можно создавать на каждый вызов
+class Printer {
+public:
+    static const int INDENT_STEP = 4;
+
+    // В buffer занято used байт; buffer имеет размер OUTPUT_BUFFER_SIZE или больше
+    Printer(std::string& buffer, size_t& used, std::ostream& out, const PrintOptions& options)
+        : buffer_(buffer)
+        , used_(used)
+        , out_(out)
+        , options_(options) {
     }
-}
 
-Node LoadNumber(std::istream& input) {
-    std::string parsed_num;
+    void PrintNode(const Node& node, int indent) {
+        std::visit([this, indent](const auto& value) {
+            PrintValue(value, indent);
+        }, node.GetValue());
+    }
 
-    // Считывает в parsed_num очередной символ из input
-    auto read_char = [&parsed_num, &input] {
-        parsed_num += static_cast<char>(input.get());
-        if (!input) {
-            throw ParsingError("Failed to read number from stream"s);
+    // Отступ перед элементом; в компактном режиме отступов нет
+    void PrintIndent(int indent) {
+        if (!options_.compact) {
+            AppendIndent(indent);
         }
-    };
+    }
 
-    // Считывает одну или более цифр в parsed_num из input
-    auto read_digits = [&input, read_char] {
-        if (!std::isdigit(input.peek())) {
-            throw ParsingError("A digit is expected"s);
-        }
-        while (std::isdigit(input.peek())) {
-            read_char();
+    void Append(std::string_view text) {
+        if (used_ + text.size() > buffer_.size()) {
+            Overflow(text.size());
         }
-    };
+        std::memcpy(buffer_.data() + used_, text.data(), text.size());
+        used_ += text.size();
+    }
 
-    if (input.peek() == '-') {
-        read_char();
+    void PrintInt(int value) {
+        char chars[16];
+        const auto result = std::to_chars(std::begin(chars), std::end(chars), value);
+        Append({ chars, static_cast<size_t>(result.ptr - chars) });
     }
-    // Парсим целую часть числа
-    if (input.peek() == '0') {
-        read_char();
-        // После 0 в JSON не могут идти другие цифры
-    } else {
-        read_digits();
+
+    // По умолчанию число выводится как operator<< с точностью 6, в компактном
+    // режиме — кратчайшей записью, которая читается обратно без потерь
+    void PrintDouble(double value) {
+        char chars[32];
+        const auto result = options_.compact
+            ? std::to_chars(std::begin(chars), std::end(chars), value)
+            : std::to_chars(std::begin(chars), std::end(chars), value, std::chars_format::general, 6);
+        Append({ chars, static_cast<size_t>(result.ptr - chars) });
     }
 
-    bool is_int = true;
-    // Парсим дробную часть числа
-    if (input.peek() == '.') {
-        read_char();
-        read_digits();
-        is_int = false;
+    void PrintString(std::string_view value) {
+        AppendEscaped(value, [this](std::string_view text) { Append(text); });
     }
 
-    // Парсим экспоненциальную часть числа
-    if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-        read_char();
-        if (ch = input.peek(); ch == '+' || ch == '-') {
-            read_char();
+    // Длинный текст передаётся потоку сразу, минуя буфер
+    void Write(std::string_view text) {
+        if (text.size() <= buffer_.size() - used_) {
+            Append(text);
+            return;
         }
-        read_digits();
-        is_int = false;
+        Flush();
+        out_.write(text.data(), static_cast<std::streamsize>(text.size()));
     }
 
-    try {
-        if (is_int) {
-            // Сначала пробуем преобразовать строку в int
-            try {
-                return std::stoi(parsed_num);
-            } catch (...) {
-                // В случае неудачи, например, при переполнении
-                // код ниже попробует преобразовать строку в double
-            }
+    void Flush() {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+
+private:
+    void Put(char c) {
+        if (used_ == buffer_.size()) {
+            Flush();
         }
-        return std::stod(parsed_num);
-    } catch (...) {
-        throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+        buffer_[used_++] = c;
     }
-}
 
-Node LoadNode(std::istream& input) {
-    char c;
-    if (!(input >> c)) {
-        throw ParsingError("Unexpected EOF"s);
+    // Освобождает буфер; строка длиннее буфера увеличивает его
+    void Overflow(size_t size) {
+        Flush();
+        if (size > buffer_.size()) {
+            buffer_.resize(size);
+        }
     }
-    switch (c) {
-        case '[':
-            return LoadArray(input);
-        case '{':
-            return LoadDict(input);
-        case '"':
-            return LoadString(input);
-        case 't':
-            // Атрибут [[fallthrough]] (провалиться) ничего не делает, и является
-            // подсказкой компилятору и человеку, что здесь программист явно задумывал
-            // разрешить переход к инструкции следующей ветки case, а не случайно забыл
-            // написать break, return или throw.
-            // В данном случае, встретив t или f, переходим к попытке парсинга
-            // литералов true либо false
-            [[fallthrough]];
-        case 'f':
-            input.putback(c);
-            return LoadBool(input);
-        case 'n':
-            input.putback(c);
-            return LoadNull(input);
-        default:
-            input.putback(c);
-            return LoadNumber(input);
+
+    void AppendIndent(int indent) {
+        for (; indent > static_cast<int>(INDENT_SPACES.size()); indent -= static_cast<int>(INDENT_SPACES.size())) {
+            Append(INDENT_SPACES);
+        }
+        Append(INDENT_SPACES.substr(0, indent));
+    }
+
+    void PrintValue(std::nullptr_t, int) {
+        Append("null"sv);
+    }
+
+    void PrintValue(bool value, int) {
+        Append(value ? "true"sv : "false"sv);
+    }
+
+    void PrintValue(int value, int) {
+        PrintInt(value);
+    }
+
+    void PrintValue(double value, int) {
+        PrintDouble(value);
     }
-}
 
-struct PrintContext {
-    std::ostream& out;
-    int indent_step = 4;
-    int indent = 0;
+    void PrintValue(const std::string& value, int) {
+        PrintString(value);
+    }
 
-    void PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+    void PrintValue(const Array& nodes, int indent) {
+        if (options_.compact) {
+            Put('[');
+            bool first = true;
+            for (const Node& node : nodes) {
+                if (!first) {
+                    Put(',');
+                }
+                first = false;
+                PrintNode(node, indent);
+            }
+            Put(']');
+            return;
         }
+        Append("[\n"sv);
+        bool first = true;
+        const int inner_indent = indent + INDENT_STEP;
+        for (const Node& node : nodes) {
+            if (first) {
+                first = false;
+            } else {
+                Append(",\n"sv);
+            }
+            AppendIndent(inner_indent);
+            PrintNode(node, inner_indent);
+        }
+        Put('\n');
+        AppendIndent(indent);
+        Put(']');
     }
 
-    PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
+    void PrintValue(const Dict& nodes, int indent) {
+        if (options_.compact) {
+            Put('{');
+            bool first = true;
+            for (const auto& [key, node] : nodes) {
+                if (!first) {
+                    Put(',');
+                }
+                first = false;
+                PrintString(key);
+                Put(':');
+                PrintNode(node, indent);
+            }
+            Put('}');
+            return;
+        }
+        Append("{\n"sv);
+        bool first = true;
+        const int inner_indent = indent + INDENT_STEP;
+        for (const auto& [key, node] : nodes) {
+            if (first) {
+                first = false;
+            } else {
+                Append(",\n"sv);
+            }
+            AppendIndent(inner_indent);
+            PrintString(key);
+            Append(": "sv);
+            PrintNode(node, inner_indent);
+        }
+        Put('\n');
+        AppendIndent(indent);
+        Put('}');
     }
+
+    std::string& buffer_;
+    size_t& used_;
+    std::ostream& out_;
+    const PrintOptions& options_;
 };
 
-void PrintNode(const Node& value, const PrintContext& ctx);
+}  // namespace
 
-template <typename Value>
-void PrintValue(const Value& value, const PrintContext& ctx) {
-    ctx.out << value;
+Document Load(std::istream& input) {
+    const std::string buffer{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    return Load(buffer);
 }
 
-void PrintString(const std::string& value, std::ostream& out) {
-    out.put('"');
-    for (const char c : value) {
-        switch (c) {
-            case '\r':
-                out << "\\r"sv;
-                break;
-            case '\n':
-                out << "\\n"sv;
-                break;
-            case '"':
-                // Символы " и \ выводятся как \" или \\, соответственно
-                [[fallthrough]];
-            case '\\':
-                out.put('\\');
-                [[fallthrough]];
-            default:
-                out.put(c);
-                break;
-        }
+Document Load(std::string_view input) {
+    TreeBuilder builder;
+    Parser<TreeBuilder>(input, builder).ParseNode();
+    return Document{builder.Extract()};
+}
+
+void Parse(std::string_view input, Handler& handler) {
+    Parser<Handler>(input, handler).ParseNode();
+}
+
+// ---------- TreeBuilder ------------------
+
+void TreeBuilder::StartDict() {
+    stack_.push_back({Node(Dict{}), {}});
+}
+
+void TreeBuilder::Key(std::string&& key) {
+    Frame& frame = stack_.back();
+    const Dict& dict = frame.container.AsDict();
+    if (dict.find(key) != dict.end()) {
+        throw ParsingError("Duplicate key '"s + key + "' have been found");
     }
-    out.put('"');
+    frame.key = std::move(key);
 }
 
-template <>
-void PrintValue<std::string>(const std::string& value, const PrintContext& ctx) {
-    PrintString(value, ctx.out);
+void TreeBuilder::EndDict() {
+    Node dict = std::move(stack_.back().container);
+    stack_.pop_back();
+    Add(std::move(dict));
 }
 
-template <>
-void PrintValue<std::nullptr_t>(const std::nullptr_t&, const PrintContext& ctx) {
-    ctx.out << "null"sv;
+void TreeBuilder::StartArray() {
+    stack_.push_back({Node(Array{}), {}});
 }
 
-// В специализаци шаблона PrintValue для типа bool параметр value передаётся
-// по константной ссылке, как и в основном шаблоне.
-// В качестве альтернативы можно использовать перегрузку:
-// void PrintValue(bool value, const PrintContext& ctx);
-template <>
-void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
-    ctx.out << (value ? "true"sv : "false"sv);
+void TreeBuilder::EndArray() {
+    Node array = std::move(stack_.back().container);
+    stack_.pop_back();
+    Add(std::move(array));
 }
 
-template <>
-void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "[\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const Node& node : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintNode(node, inner_ctx);
+void TreeBuilder::Value(Node::Value&& value) {
+    Add(Node(std::move(value)));
+}
+
+void TreeBuilder::Add(Node&& node) {
+    if (stack_.empty()) {
+        root_ = std::move(node);
+        is_complete_ = true;
+        return;
+    }
+    Frame& frame = stack_.back();
+    if (frame.container.IsArray()) {
+        std::get<Array>(frame.container.GetValue()).push_back(std::move(node));
+    } else {
+        std::get<Dict>(frame.container.GetValue()).emplace(std::move(frame.key), std::move(node));
     }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put(']');
 }
 
-template <>
-void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "{\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const auto& [key, node] : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
+Node TreeBuilder::Extract() {
+    is_complete_ = false;
+    return std::move(root_);
+}
+
+void Print(const Document& doc, std::ostream& output, const PrintOptions& options) {
+    Writer writer(output, options);
+    writer.Value(doc.GetRoot());
+    writer.Flush();
+}
+
+// ---------- PreparedString ------------------
+
+PreparedString::PreparedString(std::string value)
+    : value_(std::move(value)) {
+    literal_.reserve(value_.size() + 2);
+    AppendEscaped(value_, [this](std::string_view text) { literal_.append(text); });
+}
+
+PreparedString PreparedString::Insert(size_t tail_size, std::string_view text) const {
+    const std::string_view value(value_);
+    const std::string_view literal(literal_);
+    const size_t value_split = value.size() - tail_size;
+    // В записи за хвостом следует закрывающая кавычка
+    const size_t literal_split = literal.size() - 1 - tail_size;
+
+    PreparedString result;
+    result.value_.reserve(value.size() + text.size());
+    result.value_.append(value.substr(0, value_split)).append(text).append(value.substr(value_split));
+    result.literal_.reserve(literal.size() + text.size() + 2);
+    result.literal_.append(literal.substr(0, literal_split));
+    // Кавычки, которые добавляет AppendEscaped, отбрасываются
+    bool is_quote = true;
+    AppendEscaped(text, [&result, &is_quote](std::string_view part) {
+        if (!is_quote) {
+            result.literal_.append(part);
         }
-        inner_ctx.PrintIndent();
-        PrintString(key, ctx.out);
-        out << ": "sv;
-        PrintNode(node, inner_ctx);
+        is_quote = false;
+    });
+    result.literal_.pop_back();
+    result.literal_.append(literal.substr(literal_split));
+    return result;
+}
+
+// ---------- Writer ------------------
+
+Writer::Writer(std::ostream& output, const PrintOptions& options)
+    : output_(output)
+    , options_(options)
+    , buffer_(OUTPUT_BUFFER_SIZE, '\0') {
+}
+
+void Writer::BeforeValue() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
     }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put('}');
+    if (frames_.empty()) {
+        return;
+    }
+    Printer printer(buffer_, used_, output_, options_);
+    Frame& frame = frames_.back();
+    if (!frame.is_empty) {
+        printer.Append(options_.compact ? ","sv : ",\n"sv);
+    }
+    frame.is_empty = false;
+    printer.PrintIndent(static_cast<int>(frames_.size()) * Printer::INDENT_STEP);
 }
 
-void PrintNode(const Node& node, const PrintContext& ctx) {
-    std::visit(
-        [&ctx](const auto& value) {
-            PrintValue(value, ctx);
-        },
-        node.GetValue());
+Writer& Writer::StartDict() {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).Append(options_.compact ? "{"sv : "{\n"sv);
+    frames_.push_back({true, true});
+    return *this;
 }
 
-}  // namespace
+Writer& Writer::Key(std::string_view key) {
+    BeforeValue();
+    Printer printer(buffer_, used_, output_, options_);
+    printer.PrintString(key);
+    printer.Append(options_.compact ? ":"sv : ": "sv);
+    after_key_ = true;
+    return *this;
+}
 
-Document Load(std::istream& input) {
-    return Document{LoadNode(input)};
+Writer& Writer::EndDict() {
+    frames_.pop_back();
+    Printer printer(buffer_, used_, output_, options_);
+    if (!options_.compact) {
+        printer.Append("\n"sv);
+        printer.PrintIndent(static_cast<int>(frames_.size()) * Printer::INDENT_STEP);
+    }
+    printer.Append("}"sv);
+    return *this;
+}
+
+Writer& Writer::StartArray() {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).Append(options_.compact ? "["sv : "[\n"sv);
+    frames_.push_back({false, true});
+    return *this;
+}
+
+Writer& Writer::EndArray() {
+    frames_.pop_back();
+    Printer printer(buffer_, used_, output_, options_);
+    if (!options_.compact) {
+        printer.Append("\n"sv);
+        printer.PrintIndent(static_cast<int>(frames_.size()) * Printer::INDENT_STEP);
+    }
+    printer.Append("]"sv);
+    return *this;
+}
+
+Writer& Writer::Value(std::nullptr_t) {
+    return Value(Node(nullptr));
+}
+
+Writer& Writer::Value(bool value) {
+    return Value(Node(value));
+}
+
+Writer& Writer::Value(int value) {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).PrintInt(value);
+    return *this;
+}
+
+Writer& Writer::Value(double value) {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).PrintDouble(value);
+    return *this;
+}
+
+Writer& Writer::Value(std::string_view value) {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).PrintString(value);
+    return *this;
+}
+
+Writer& Writer::Value(const PreparedString& value) {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).Write(value.GetLiteral());
+    return *this;
+}
+
+Writer& Writer::Value(const Node& node) {
+    BeforeValue();
+    Printer(buffer_, used_, output_, options_).PrintNode(node, static_cast<int>(frames_.size()) * Printer::INDENT_STEP);
+    return *this;
 }
 
-void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{output});
+void Writer::Flush() {
+    Printer(buffer_, used_, output_, options_).Flush();
 }
 
-}  // namespace json
\ No newline at end of file
+}  // namespace json
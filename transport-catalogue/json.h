@@ -3,6 +3,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -141,8 +142,138 @@ namespace json {
         return !(lhs == rhs);
     }
 
+    // Получает элементы документа по мере разбора, не дожидаясь построения дерева.
+    // Ключ словаря сообщается после проверки двоеточия, перед значением
+    class Handler {
+    public:
+        virtual void StartDict() = 0;
+        virtual void Key(std::string&& key) = 0;
+        virtual void EndDict() = 0;
+        virtual void StartArray() = 0;
+        virtual void EndArray() = 0;
+        // Скалярное значение: null, bool, int, double или строка
+        virtual void Value(Node::Value&& value) = 0;
+
+    protected:
+        ~Handler() = default;
+    };
+
+    // Собирает из событий разбора дерево одного значения, например элемента массива
+    class TreeBuilder final : public Handler {
+    public:
+        void StartDict() override;
+        void Key(std::string&& key) override;
+        void EndDict() override;
+        void StartArray() override;
+        void EndArray() override;
+        void Value(Node::Value&& value) override;
+
+        // Значение полностью собрано
+        bool IsComplete() const {
+            return is_complete_;
+        }
+
+        Node Extract();
+
+    private:
+        struct Frame {
+            Node container;
+            std::string key;
+        };
+
+        void Add(Node&& node);
+
+        std::vector<Frame> stack_;
+        Node root_;
+        bool is_complete_ = false;
+    };
+
+    // Разбирает JSON из буфера, передавая элементы обработчику
+    void Parse(std::string_view input, Handler& handler);
+
+    // Читает поток до конца и разбирает его содержимое
     Document Load(std::istream& input);
 
-    void Print(const Document& doc, std::ostream& output);
+    // Разбирает JSON из буфера, например из отображённого в память файла
+    Document Load(std::string_view input);
+
+    struct PrintOptions {
+        // compact — без переводов строк и отступов, вещественные числа в кратчайшей
+        // точной записи; для программ, читающих ответ
+        bool compact = false;
+    };
+
+    // Вывод накапливается в буфере и передаётся потоку крупными блоками
+    void Print(const Document& doc, std::ostream& output, const PrintOptions& options = {});
+
+    // Строка вместе с готовой записью в JSON. Writer выводит запись как есть,
+    // поэтому строка, которая выводится много раз, экранируется один раз
+    class PreparedString {
+    public:
+        explicit PreparedString(std::string value);
+
+        const std::string& Get() const {
+            return value_;
+        }
+
+        // Строка в кавычках с экранированными символами
+        std::string_view GetLiteral() const {
+            return literal_;
+        }
+
+        // Та же строка с text, вставленным перед последними tail_size символами. Экранируется
+        // только text, поэтому в хвосте не должно быть символов, которые экранируются
+        PreparedString Insert(size_t tail_size, std::string_view text) const;
+
+    private:
+        PreparedString() = default;
+
+        std::string value_;
+        std::string literal_;
+    };
+
+    // Выводит JSON по элементам, не строя дерево. Результат совпадает с Print
+    // для документа из тех же значений; вывод передаётся потоку крупными блоками
+    class Writer {
+    public:
+        explicit Writer(std::ostream& output, const PrintOptions& options = {});
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        Writer& StartDict();
+        // Ключи выводятся в порядке вызовов; для совпадения с Print — по возрастанию
+        Writer& Key(std::string_view key);
+        Writer& EndDict();
+        Writer& StartArray();
+        Writer& EndArray();
+
+        Writer& Value(std::nullptr_t);
+        Writer& Value(bool value);
+        Writer& Value(int value);
+        Writer& Value(double value);
+        Writer& Value(std::string_view value);
+        Writer& Value(const PreparedString& value);
+        Writer& Value(const Node& node);
+
+        // Передаёт накопленный вывод потоку
+        void Flush();
+
+    private:
+        struct Frame {
+            bool is_dict;
+            bool is_empty;
+        };
+
+        // Разделитель и отступ перед очередным значением
+        void BeforeValue();
+
+        std::ostream& output_;
+        PrintOptions options_;
+        std::string buffer_;
+        size_t used_ = 0;
+        std::vector<Frame> frames_;
+        bool after_key_ = false;
+    };
 
 }  // namespace json
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "json_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+namespace json::arena {
+
+using namespace std::literals;
+
+namespace {
+
+// Начальный размер блока арены; следующие блоки растут геометрически
+const size_t INITIAL_ARENA_BLOCK = 64 * 1024;
+
+// Собирает документ из событий разбора. Элементы открытых массивов и словарей
+// копятся в общих буферах и переносятся в арену одним куском при закрытии
+class ArenaBuilder final : public json::Handler {
+public:
+    explicit ArenaBuilder(std::pmr::memory_resource& arena)
+        : arena_(arena) {
+    }
+
+    void StartDict() override {
+        frames_.push_back({true, members_.size(), {}});
+    }
+
+    void Key(std::string&& key) override {
+        frames_.back().key = Intern(key);
+    }
+
+    void EndDict() override {
+        const size_t begin = frames_.back().begin;
+        frames_.pop_back();
+        const auto first = members_.begin() + begin;
+        std::sort(first, members_.end(), [](const Member& lhs, const Member& rhs) {
+            return lhs.first < rhs.first;
+        });
+        const auto duplicate = std::adjacent_find(first, members_.end(), [](const Member& lhs, const Member& rhs) {
+            return lhs.first == rhs.first;
+        });
+        if (duplicate != members_.end()) {
+            throw ParsingError("Duplicate key '"s + std::string(duplicate->first) + "' have been found"s);
+        }
+        const size_t size = members_.size() - begin;
+        const Member* members = Copy(&*first, size);
+        members_.resize(begin);
+        Add(Node(members, size));
+    }
+
+    void StartArray() override {
+        frames_.push_back({false, items_.size(), {}});
+    }
+
+    void EndArray() override {
+        const size_t begin = frames_.back().begin;
+        frames_.pop_back();
+        const size_t size = items_.size() - begin;
+        const Node* items = Copy(items_.data() + begin, size);
+        items_.resize(begin);
+        Add(Node(items, size));
+    }
+
+    void Value(json::Node::Value&& value) override {
+        std::visit([this](auto& scalar) {
+            using Scalar = std::decay_t<decltype(scalar)>;
+            if constexpr (std::is_same_v<Scalar, std::string>) {
+                Add(Node(CopyString(scalar)));
+            }
+            else if constexpr (std::is_same_v<Scalar, std::nullptr_t>) {
+                Add(Node());
+            }
+            else if constexpr (std::is_same_v<Scalar, bool> || std::is_same_v<Scalar, int> || std::is_same_v<Scalar, double>) {
+                Add(Node(scalar));
+            }
+        }, value);
+    }
+
+    Node GetRoot() const {
+        return root_;
+    }
+
+private:
+    struct Frame {
+        bool is_dict;
+        // Начало элементов словаря в members_ или массива в items_
+        size_t begin;
+        std::string_view key;
+    };
+
+    void Add(Node node) {
+        if (frames_.empty()) {
+            root_ = node;
+        }
+        else if (frames_.back().is_dict) {
+            members_.emplace_back(frames_.back().key, node);
+        }
+        else {
+            items_.push_back(node);
+        }
+    }
+
+    template <typename T>
+    const T* Copy(const T* values, size_t size) {
+        if (size == 0) {
+            return nullptr;
+        }
+        T* copy = static_cast<T*>(arena_.allocate(size * sizeof(T), alignof(T)));
+        std::uninitialized_copy_n(values, size, copy);
+        return copy;
+    }
+
+    std::string_view CopyString(std::string_view value) {
+        if (value.empty()) {
+            return {};
+        }
+        char* copy = static_cast<char*>(arena_.allocate(value.size(), 1));
+        std::memcpy(copy, value.data(), value.size());
+        return { copy, value.size() };
+    }
+
+    // Ключи повторяются во всех запросах ("type", "name", "id"), поэтому каждый хранится один раз
+    std::string_view Intern(std::string_view key) {
+        if (auto it = keys_.find(key); it != keys_.end()) {
+            return *it;
+        }
+        return *keys_.insert(CopyString(key)).first;
+    }
+
+    std::pmr::memory_resource& arena_;
+    std::vector<Frame> frames_;
+    std::vector<Member> members_;
+    std::vector<Node> items_;
+    std::unordered_set<std::string_view> keys_;
+    Node root_;
+};
+
+}  // namespace
+
+Dict::const_iterator Dict::find(std::string_view key) const {
+    const auto it = std::lower_bound(begin(), end(), key, [](const Member& member, std::string_view key) {
+        return member.first < key;
+    });
+    return it != end() && it->first == key ? it : end();
+}
+
+const Node& Dict::at(std::string_view key) const {
+    if (auto it = find(key); it != end()) {
+        return it->second;
+    }
+    throw std::out_of_range("Key '"s + std::string(key) + "' is not found"s);
+}
+
+Document Load(std::string_view input) {
+    auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(
+        std::min(std::max(input.size(), size_t{1024}), INITIAL_ARENA_BLOCK));
+    ArenaBuilder builder(*arena);
+    Parse(input, builder);
+    return Document(std::move(arena), builder.GetRoot());
+}
+
+}  // namespace json::arena
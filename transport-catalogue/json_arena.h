@@ -0,0 +1,189 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+// Неизменяемое представление JSON, все данные которого лежат в одной арене документа.
+// Словарь хранится как отсортированный по ключу массив пар, одинаковые ключи
+// хранятся в арене один раз. Методы доступа повторяют json::Node, но строки
+// возвращаются как std::string_view, а массивы и словари — как лёгкие представления
+namespace json::arena {
+
+    class Node;
+    class Array;
+    class Dict;
+    using Member = std::pair<std::string_view, Node>;
+
+    class Node {
+    public:
+        Node() = default;
+        explicit Node(bool value) : type_(Type::BOOL), bool_(value) {}
+        explicit Node(int value) : type_(Type::INT), int_(value) {}
+        explicit Node(double value) : type_(Type::DOUBLE), double_(value) {}
+        explicit Node(std::string_view value)
+            : type_(Type::STRING), size_(static_cast<uint32_t>(value.size())), chars_(value.data()) {}
+        Node(const Node* items, size_t size)
+            : type_(Type::ARRAY), size_(static_cast<uint32_t>(size)), items_(items) {}
+        Node(const Member* members, size_t size)
+            : type_(Type::DICT), size_(static_cast<uint32_t>(size)), members_(members) {}
+
+        bool IsNull() const {
+            return type_ == Type::NUL;
+        }
+
+        bool IsInt() const {
+            return type_ == Type::INT;
+        }
+        int AsInt() const {
+            if (!IsInt()) {
+                throw std::logic_error("Not an int");
+            }
+            return int_;
+        }
+
+        bool IsPureDouble() const {
+            return type_ == Type::DOUBLE;
+        }
+        bool IsDouble() const {
+            return IsInt() || IsPureDouble();
+        }
+        double AsDouble() const {
+            if (!IsDouble()) {
+                throw std::logic_error("Not a double");
+            }
+            return IsPureDouble() ? double_ : int_;
+        }
+
+        bool IsBool() const {
+            return type_ == Type::BOOL;
+        }
+        bool AsBool() const {
+            if (!IsBool()) {
+                throw std::logic_error("Not a bool");
+            }
+            return bool_;
+        }
+
+        bool IsString() const {
+            return type_ == Type::STRING;
+        }
+        std::string_view AsString() const {
+            if (!IsString()) {
+                throw std::logic_error("Not a string");
+            }
+            return { chars_, size_ };
+        }
+
+        bool IsArray() const {
+            return type_ == Type::ARRAY;
+        }
+        Array AsArray() const;
+
+        bool IsDict() const {
+            return type_ == Type::DICT;
+        }
+        Dict AsDict() const;
+
+    private:
+        enum class Type : uint8_t { NUL, BOOL, INT, DOUBLE, STRING, ARRAY, DICT };
+
+        Type type_ = Type::NUL;
+        uint32_t size_ = 0;
+        union {
+            bool bool_;
+            int int_;
+            double double_;
+            const char* chars_;
+            const Node* items_;
+            const Member* members_ = nullptr;
+        };
+    };
+
+    class Array {
+    public:
+        Array(const Node* items, size_t size) : items_(items), size_(size) {}
+
+        const Node* begin() const { return items_; }
+        const Node* end() const { return items_ + size_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const Node& operator[](size_t pos) const { return items_[pos]; }
+
+        const Node& at(size_t pos) const {
+            if (pos >= size_) {
+                throw std::out_of_range("Array index is out of range");
+            }
+            return items_[pos];
+        }
+
+    private:
+        const Node* items_;
+        size_t size_;
+    };
+
+    // Пары упорядочены по ключу, как и в json::Dict, поэтому поиск двоичный
+    class Dict {
+    public:
+        using const_iterator = const Member*;
+
+        Dict(const Member* members, size_t size) : members_(members), size_(size) {}
+
+        const_iterator begin() const { return members_; }
+        const_iterator end() const { return members_ + size_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        const_iterator find(std::string_view key) const;
+
+        size_t count(std::string_view key) const {
+            return find(key) != end() ? 1 : 0;
+        }
+
+        // Бросает std::out_of_range, если ключа нет
+        const Node& at(std::string_view key) const;
+
+    private:
+        const Member* members_;
+        size_t size_;
+    };
+
+    inline Array Node::AsArray() const {
+        if (!IsArray()) {
+            throw std::logic_error("Not an array");
+        }
+        return { items_, size_ };
+    }
+
+    inline Dict Node::AsDict() const {
+        if (!IsDict()) {
+            throw std::logic_error("Not a dict");
+        }
+        return { members_, size_ };
+    }
+
+    class Document {
+    public:
+        Document(std::unique_ptr<std::pmr::monotonic_buffer_resource> arena, Node root)
+            : arena_(std::move(arena)), root_(root) {
+        }
+
+        const Node& GetRoot() const {
+            return root_;
+        }
+
+    private:
+        // Узлы ссылаются на память арены, поэтому при перемещении документа она остаётся на месте
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+        Node root_;
+    };
+
+    // Разбирает JSON с теми же правилами и сообщениями об ошибках, что и json::Load
+    Document Load(std::string_view input);
+
+}  // namespace json::arena
@@ -3,28 +3,45 @@
 
 namespace json {
 
+    std::vector<Node>& Builder::SpareStack() {
+        thread_local std::vector<Node> spare;
+        return spare;
+    }
+
+    Builder::Builder()
+        : nodes_stack_(std::move(SpareStack())) {
+    }
+
+    Builder::~Builder() {
+        std::vector<Node>& spare = SpareStack();
+        if (nodes_stack_.capacity() > spare.capacity()) {
+            nodes_stack_.clear();
+            spare = std::move(nodes_stack_);
+        }
+    }
+
     Builder::KeyContext Builder::Key(std::string key) {
-        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back()->IsDict())
+        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back().IsDict())
             throw std::logic_error("can't add key");
-        nodes_stack_.emplace_back(std::make_unique<Node>(key));
+        nodes_stack_.emplace_back(std::move(key));
         return *this;
     }
 
     Builder::BaseContext Builder::Value(Node::Value value) {
-        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back()->IsArray() || nodes_stack_.back()->IsString()))
+        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back().IsArray() || nodes_stack_.back().IsString()))
             throw std::logic_error("can't add Value");
 
         if (nodes_stack_.empty()) {
-            root_ = Node(move(value));
+            root_ = Node(std::move(value));
         }
-        else if (nodes_stack_.back()->IsArray()) {
-            std::get<Array>(nodes_stack_.back()->GetValue()).emplace_back(move(value));
+        else if (nodes_stack_.back().IsArray()) {
+            std::get<Array>(nodes_stack_.back().GetValue()).emplace_back(std::move(value));
             // return ArrayItemContext(*this);
         }
-        else if (nodes_stack_.back()->IsString()) {
-            std::string key = std::get<std::string>(nodes_stack_.back()->GetValue());
+        else if (nodes_stack_.back().IsString()) {
+            std::string key = std::move(std::get<std::string>(nodes_stack_.back().GetValue()));
             nodes_stack_.pop_back();
-            std::get<Dict>(nodes_stack_.back()->GetValue()).emplace(std::move(key), std::move(value));
+            std::get<Dict>(nodes_stack_.back().GetValue()).emplace(std::move(key), std::move(value));
             //return DictItemContext(*this);
         }
 
@@ -37,43 +54,43 @@ namespace json {
     }
 
     Builder::DictItemContext Builder::StartDict() {
-        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back()->IsArray() || nodes_stack_.back()->IsString()))
+        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back().IsArray() || nodes_stack_.back().IsString()))
             throw std::logic_error("can't add Dict");
-        nodes_stack_.emplace_back(std::make_unique<Node>(Dict()));
+        nodes_stack_.emplace_back(Dict());
         return *this;
     }
 
 
     Builder::ArrayItemContext Builder::StartArray() {
-        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back()->IsArray() || nodes_stack_.back()->IsString()))
+        if (!root_.IsNull() || !(nodes_stack_.empty() || nodes_stack_.back().IsArray() || nodes_stack_.back().IsString()))
             throw std::logic_error("can't add Array");
-        nodes_stack_.emplace_back(std::make_unique<Node>(Array()));
+        nodes_stack_.emplace_back(Array());
         return *this;
     }
 
     Builder::BaseContext Builder::EndDict() {
-        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back()->IsDict())
+        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back().IsDict())
             throw std::logic_error("can't complete Dict");
-        Node::Value val = nodes_stack_.back().release()->GetValue();
+        Node::Value val = std::move(nodes_stack_.back().GetValue());
         nodes_stack_.pop_back();
-        Value(move(val));
+        Value(std::move(val));
         return *this;
     }
 
 
     Builder::BaseContext Builder::EndArray() {
-        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back()->IsArray())
+        if (!root_.IsNull() || nodes_stack_.empty() || !nodes_stack_.back().IsArray())
             throw std::logic_error("can't complete Array");
-        Node::Value val = nodes_stack_.back().release()->GetValue();
+        Node::Value val = std::move(nodes_stack_.back().GetValue());
         nodes_stack_.pop_back();
-        Value(move(val));
+        Value(std::move(val));
         return *this;
     }
 
 
-    Node& Builder::Build() {
+    Node Builder::Build() {
         if (root_.IsNull() || !nodes_stack_.empty())
             throw std::logic_error("error Build()");
-        return root_;
+        return std::move(root_);
     }
 }
\ No newline at end of file
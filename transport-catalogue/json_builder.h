@@ -11,7 +11,11 @@ namespace json {
 
     private:
         Node root_ = nullptr;
-        std::vector<std::unique_ptr<Node>> nodes_stack_;
+        // Открытые контейнеры и ключи хранятся по значению. Память стека переходит
+        // от одного построителя к следующему в том же потоке
+        std::vector<Node> nodes_stack_;
+
+        static std::vector<Node>& SpareStack();
 
         class BaseContext;
         class EndContext;
@@ -37,7 +41,7 @@ namespace json {
             }
 
             KeyContext Key(std::string key) {
-                return builder_.Key(key);
+                return builder_.Key(std::move(key));
             }
 
             ArrayItemContext StartArray() {
@@ -48,10 +52,10 @@ namespace json {
                 return builder_.StartDict();
             }
             BaseContext Value(Node::Value value) {
-                return builder_.Value(value);
+                return builder_.Value(std::move(value));
             }
 
-            Node& Build() {
+            Node Build() {
                 return builder_.Build();
             }
         };
@@ -63,11 +67,9 @@ namespace json {
             BaseContext EndArray() = delete;
             BaseContext EndDict() = delete;
             BaseContext Key(std::string key) = delete;
-            Node& Build() = delete;
+            Node Build() = delete;
             DictItemContext Value(Node::Value value) {
-                std::string key = std::get<std::string>(builder_.nodes_stack_.back()->GetValue());
-                builder_.nodes_stack_.pop_back();
-                std::get<Dict>(builder_.nodes_stack_.back()->GetValue()).emplace(std::move(key), std::move(value));
+                builder_.Value(std::move(value));
                 return builder_;
             }
         };
@@ -80,7 +82,7 @@ namespace json {
             BaseContext StartArray() = delete;
             BaseContext StartDict() = delete;
             BaseContext Value(Node::Value value) = delete;
-            Node& Build() = delete;
+            Node Build() = delete;
 
         };
 
@@ -90,9 +92,9 @@ namespace json {
             ArrayItemContext(Builder& builder) : BaseContext(builder) {}
             BaseContext Key(std::string key) = delete;
             BaseContext EndDict() = delete;
-            Node& Build() = delete;
+            Node Build() = delete;
             ArrayItemContext Value(Node::Value value){
-                std::get<Array>(builder_.nodes_stack_.back()->GetValue()).emplace_back(move(value));
+                builder_.Value(std::move(value));
                 return builder_;
             }
         };
@@ -101,7 +103,12 @@ namespace json {
     public:
 
 
-        Builder() {}
+        Builder();
+
+        Builder(const Builder&) = delete;
+        Builder& operator=(const Builder&) = delete;
+
+        ~Builder();
 
         KeyContext Key(std::string key);
 
@@ -115,6 +122,7 @@ namespace json {
 
         BaseContext EndArray();
 
-        Node& Build();
+        // Забирает построенный узел; после этого построитель пуст
+        Node Build();
     };
 }
\ No newline at end of file
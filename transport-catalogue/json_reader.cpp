@@ -1,7 +1,12 @@
 #include "json_reader.h"
 #include "json_builder.h"
 #include "transport_router.h"
+#include "mapped_file.h"
+#include "allocation_counter.h"
+#include <chrono>
+#include <future>
 #include <string_view>
+#include <thread>
 #include <unordered_set>
 
 
@@ -9,34 +14,103 @@ namespace transport_catalogue {
     namespace input_parser_reader {
         using namespace transport_catalogue::catalogue;
 
-        void ParseAddBusQuery(const Node& request, TransportCatalogue& tc) {
-            const Dict& request_data = request.AsDict();
-            if (request_data.at("type").AsString() == "Bus") {
+        namespace {
+            using Clock = std::chrono::steady_clock;
+
+            double ElapsedMs(Clock::time_point since) {
+                return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+            }
+
+            void AddAllocations(AllocationCounts* counts, std::string_view type, size_t allocations) {
+                if (!counts) {
+                    return;
+                }
+                auto it = counts->find(type);
+                if (it == counts->end()) {
+                    it = counts->emplace(std::string(type), RequestAllocations{}).first;
+                }
+                ++it->second.requests;
+                it->second.allocations += allocations;
+            }
+
+            // Меньшие отрезки запросов выгоднее обработать в текущем потоке
+            const size_t MIN_CHUNK_SIZE = 256;
+
+            // Делит запросы [0, size) на отрезки по числу ядер и параллельно применяет к ним func(begin, end).
+            // Результаты возвращаются в порядке отрезков
+            template <typename Result, typename Func>
+            std::vector<Result> ProcessInChunks(size_t size, Func func) {
+                const size_t chunks = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, std::max(1u, std::thread::hardware_concurrency()));
+                std::vector<Result> results;
+                results.reserve(chunks);
+                if (chunks == 1) {
+                    results.push_back(func(size_t{0}, size));
+                    return results;
+                }
+                std::vector<std::future<Result>> futures;
+                futures.reserve(chunks);
+                for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                    futures.push_back(std::async(std::launch::async, func, size * chunk / chunks, size * (chunk + 1) / chunks));
+                }
+                for (auto& future : futures) {
+                    results.push_back(future.get());
+                }
+                return results;
+            }
+
+            // Запросы читаются одинаково из json::Dict и из json::arena::Dict
+            template <typename RequestDict>
+            std::optional<Stop> ReadStop(const RequestDict& request_data) {
+                if (request_data.at("type").AsString() != "Stop") {
+                    return std::nullopt;
+                }
+                Stop stop;
+                stop.name = request_data.at("name").AsString();
+                stop.coordinates.lat = request_data.at("latitude").AsDouble();
+                stop.coordinates.lng = request_data.at("longitude").AsDouble();
+                return stop;
+            }
+
+            template <typename RequestDict>
+            std::optional<Bus> ReadBus(const RequestDict& request_data, const TransportCatalogue& tc) {
+                if (request_data.at("type").AsString() != "Bus") {
+                    return std::nullopt;
+                }
                 Bus bus;
                 bus.name = request_data.at("name").AsString();
                 bus.is_loop = request_data.at("is_roundtrip").AsBool();
                 const auto& stops = request_data.at("stops").AsArray();
 
+                bus.stops.reserve(stops.size());
                 for (const auto& stop : stops) {
                     bus.stops.push_back(*tc.GetStop(stop.AsString()));
                 }
-                if (!bus.is_loop) {
-
-                    for (auto begin = next(stops.rbegin()), end = stops.rend(); begin != end; ++begin) {
-                        bus.stops.push_back(*tc.GetStop((*begin).AsString()));
-                    }
-                }
-                tc.AddBus(std::move(bus));
+                return bus;
             }
-            else
-            {
-                return;
+
+            struct StopDistance {
+                const Stop* from;
+                const Stop* to;
+                int distance;
+            };
+
+            // Остановки и расстояния, найденные в отрезке запросов
+            struct ResolvedRequests {
+                std::vector<StopDistance> distances;
+                std::vector<Bus> buses;
+            };
+        }
+
+        void ParseAddBusQuery(const Node& request, TransportCatalogue& tc) {
+            if (auto bus = ReadBus(request.AsDict(), tc)) {
+                tc.AddBus(std::move(*bus));
             }
         }
 
-        svg::Color ParceColor(const Node& n) {
+        template <typename ColorNode>
+        svg::Color ParceColor(const ColorNode& n) {
             if (n.IsString())
-                return n.AsString();
+                return std::string(n.AsString());
             else {
                 if (n.AsArray().size() == 3) {
                     uint8_t r = n.AsArray().at(0).AsInt();
@@ -59,15 +133,21 @@ namespace transport_catalogue {
             }
         }
 
-        void ParseRoutingSettings(const json::Document& doc) {
-            const json::Dict& routing_settings = doc.GetRoot().AsDict().at("routing_settings").AsDict();
-            auto wait_time = routing_settings.at("bus_wait_time").AsInt();
-            auto velocity = routing_settings.at("bus_velocity").AsInt();
-            TransportRouter::SetRoutingSettings(wait_time, velocity);
+        template <typename SettingsDocument>
+        RoutingSettings ReadRoutingSettings(const SettingsDocument& doc) {
+            const auto& routing_settings = doc.GetRoot().AsDict().at("routing_settings").AsDict();
+            RoutingSettings settings;
+            settings.bus_wait_time = routing_settings.at("bus_wait_time").AsInt();
+            settings.bus_velocity = routing_settings.at("bus_velocity").AsInt();
+            if (auto it = routing_settings.find("regions"); it != routing_settings.end()) {
+                settings.regions = it->second.AsInt();
+            }
+            return settings;
         }
 
-        void ParseRenderSettings(const json::Document& doc, renderer::MapRenderer& mr) {
-            const json::Dict& v_props = doc.GetRoot().AsDict().at("render_settings").AsDict();
+        template <typename SettingsDocument>
+        void ReadRenderSettings(const SettingsDocument& doc, renderer::MapRenderer& mr) {
+            const auto& v_props = doc.GetRoot().AsDict().at("render_settings").AsDict();
             renderer::MapRenderer::VisualiseProps props;
             props.width = v_props.at("width").AsDouble();
             props.height = v_props.at("height").AsDouble();
@@ -84,23 +164,37 @@ namespace transport_catalogue {
             props.underlayer_width = v_props.at("underlayer_width").AsDouble();
             auto colors = v_props.at("color_palette").AsArray();
             props.color_palette.resize(colors.size());
-            std::transform(colors.begin(), colors.end(), props.color_palette.begin(), [](const Node& node) {
+            std::transform(colors.begin(), colors.end(), props.color_palette.begin(), [](const auto& node) {
                 return ParceColor(node); });
+            if (auto it = v_props.find("line_tolerance"); it != v_props.end()) {
+                props.line_tolerance = it->second.AsDouble();
+            }
+            if (auto it = v_props.find("stop_cluster_size"); it != v_props.end()) {
+                props.stop_cluster_size = it->second.AsDouble();
+            }
 
             mr.props = props;
         }
 
+        RoutingSettings ParseRoutingSettings(const json::Document& doc) {
+            return ReadRoutingSettings(doc);
+        }
+
+        RoutingSettings ParseRoutingSettings(const json::arena::Document& doc) {
+            return ReadRoutingSettings(doc);
+        }
+
+        void ParseRenderSettings(const json::Document& doc, renderer::MapRenderer& mr) {
+            ReadRenderSettings(doc, mr);
+        }
+
+        void ParseRenderSettings(const json::arena::Document& doc, renderer::MapRenderer& mr) {
+            ReadRenderSettings(doc, mr);
+        }
+
         void ParseStopQueryCoordinates(const Node& request, TransportCatalogue& tc) {
-            const Dict& request_data = request.AsDict();
-            if (request_data.at("type").AsString() == "Stop") {
-                Stop stop;
-                stop.name = request_data.at("name").AsString();
-                stop.coordinates.lat = request_data.at("latitude").AsDouble();
-                stop.coordinates.lng = request_data.at("longitude").AsDouble();
-                tc.AddStop(std::move(stop));
-            }
-            else {
-                return;
+            if (auto stop = ReadStop(request.AsDict())) {
+                tc.AddStop(std::move(*stop));
             }
         }
 
@@ -118,150 +212,660 @@ namespace transport_catalogue {
             }
         }
 
-        void ParseBaseRequests(const Document& doc, TransportCatalogue& tc) {
-            const Array& requests = doc.GetRoot().AsDict().at("base_requests").AsArray();
-            std::for_each(requests.begin(), requests.end(), [&](const Node& request) {ParseStopQueryCoordinates(request, tc); });
-            std::for_each(requests.begin(), requests.end(), [&](const Node& request) {ParseStopQueryDistances(request, tc); });
-            std::for_each(requests.begin(), requests.end(), [&](const Node& request) {ParseAddBusQuery(request, tc); });
+        void ParseBaseRequests(const Document& doc, TransportCatalogue& tc, StageTimings* timings) {
+            ParseBaseRequests(doc.GetRoot().AsDict().at("base_requests").AsArray(), tc, timings);
         }
 
+        template <typename RequestArray>
+        void ReadBaseRequests(const RequestArray& requests, TransportCatalogue& tc, StageTimings* timings) {
+            // Стадия 1: остановки разбираются параллельно по отрезкам и добавляются в исходном порядке
+            auto start = Clock::now();
+            auto stops = ProcessInChunks<std::vector<Stop>>(requests.size(), [&requests](size_t begin, size_t end) {
+                std::vector<Stop> chunk;
+                for (size_t i = begin; i < end; ++i) {
+                    if (auto stop = ReadStop(requests[i].AsDict())) {
+                        chunk.push_back(std::move(*stop));
+                    }
+                }
+                return chunk;
+            });
+            for (auto& chunk : stops) {
+                for (auto& stop : chunk) {
+                    tc.AddStop(std::move(stop));
+                }
+            }
+            if (timings) {
+                timings->emplace_back("stops", ElapsedMs(start));
+            }
 
-        std::vector<Node> ParseStatRequests(const Array& stat_requests, const RequestHandler& req_hndlr) {
-            using namespace std::literals;
-            std::vector<Node> res;
-            res.reserve(stat_requests.size());
+            // Стадия 2: все остановки известны, поэтому расстояния и маршруты можно
+            // разрешать параллельно, только читая справочник
+            start = Clock::now();
+            auto resolved = ProcessInChunks<ResolvedRequests>(requests.size(), [&requests, &tc](size_t begin, size_t end) {
+                ResolvedRequests chunk;
+                for (size_t i = begin; i < end; ++i) {
+                    const auto& request_data = requests[i].AsDict();
+                    if (request_data.at("type").AsString() == "Stop") {
+                        const Stop* from = *tc.GetStop(request_data.at("name").AsString());
+                        for (const auto& [other_stop, distance] : request_data.at("road_distances").AsDict()) {
+                            chunk.distances.push_back({ from, *tc.GetStop(other_stop), distance.AsInt() });
+                        }
+                    }
+                    else if (auto bus = ReadBus(request_data, tc)) {
+                        chunk.buses.push_back(std::move(*bus));
+                    }
+                }
+                return chunk;
+            });
+            if (timings) {
+                timings->emplace_back("resolve", ElapsedMs(start));
+            }
 
-            for (const auto& request : stat_requests) {
+            // Расстояния и маршруты хранятся в разных таблицах справочника и добавляются одновременно
+            start = Clock::now();
+            double distances_ms = 0;
+            auto distances = std::async(std::launch::async, [&] {
+                const auto distances_start = Clock::now();
+                for (const auto& chunk : resolved) {
+                    for (const auto& [from, to, distance] : chunk.distances) {
+                        tc.SetDistance(from, to, distance);
+                    }
+                }
+                distances_ms = ElapsedMs(distances_start);
+            });
+            for (auto& chunk : resolved) {
+                for (auto& bus : chunk.buses) {
+                    tc.AddBus(std::move(bus));
+                }
+            }
+            const double buses_ms = ElapsedMs(start);
+            distances.get();
+            if (timings) {
+                timings->emplace_back("distances", distances_ms);
+                timings->emplace_back("buses", buses_ms);
+            }
+        }
 
-                if (request.AsDict().at("type"s).AsString() == "Bus"s) {
-                    int id = request.AsDict().at("id"s).AsInt();
-                    std::string bus_name = request.AsDict().at("name"s).AsString();
-
-                    if (auto resp = req_hndlr.GetBusStat(bus_name)) {
-                        res.push_back(
-                            Builder{}
-                            .StartDict()
-                            .Key("curvature"s).Value(resp->curvature)
-                            .Key("request_id"s).Value(id)
-                            .Key("route_length"s).Value(resp->real_route_lenght)
-                            .Key("stop_count"s).Value(resp->bus_stops_count)
-                            .Key("unique_stop_count"s).Value(resp->unique_stops_count)
-                            .EndDict()
-                            .Build()
-                        );
+        namespace {
+            // Принимает события разбора входного документа и добавляет элементы base_requests
+            // в справочник по одному, не храня массив целиком. Остальные ключи верхнего
+            // уровня собираются в обычный словарь
+            class BaseRequestsReader final : public json::Handler {
+            public:
+                BaseRequestsReader(TransportCatalogue& tc, const StatRequestsStart& on_stat_requests)
+                    : tc_(tc)
+                    , on_stat_requests_(on_stat_requests) {
+                }
+
+                void StartDict() override {
+                    if (depth_ == 0 && !plain_root_) {
+                        depth_ = 1;
+                        return;
+                    }
+                    Forward([](json::Handler& value) { value.StartDict(); });
+                }
+
+                void Key(std::string&& key) override {
+                    if (IsCapturing()) {
+                        if (IsInStatRequests()) {
+                            request_.Key(std::move(key));
+                        }
+                        else {
+                            value_.Key(std::move(key));
+                        }
+                        return;
+                    }
+                    if (root_.count(key) || (key == "base_requests" && is_streamed_) || (key == "stat_requests" && responses_)) {
+                        throw ParsingError("Duplicate key '" + key + "' have been found");
+                    }
+                    key_ = std::move(key);
+                }
+
+                void EndDict() override {
+                    if (IsCapturing()) {
+                        Forward([](json::Handler& value) { value.EndDict(); });
                     }
                     else {
-                        res.push_back(
-                            Builder{}
-                            .StartDict()                            
-                            .Key("request_id"s).Value(id)
-                            .Key("error_message"s).Value("not found"s)
-                            .EndDict()
-                            .Build()
-                        );
+                        depth_ = 0;
                     }
                 }
-                else if (request.AsDict().at("type").AsString() == "Stop") {
-                    auto id = request.AsDict().at("id").AsInt();
-                    auto stop_name = request.AsDict().at("name").AsString();
-
-                    if (auto resp = req_hndlr.GetBusesByStop(stop_name)) {
-                        Array arr(resp->size());
-                        std::transform(resp->begin(), resp->end(), arr.begin(), [](std::string_view sv) {return std::string(sv); });
-                        res.push_back(
-                            Builder{}
-                            .StartDict()
-                            .Key("buses").Value(arr)
-                            .Key("request_id").Value(id)
-                            .EndDict()
-                            .Build()
-                        );
+
+                void StartArray() override {
+                    if (depth_ == 1 && !IsCapturing() && !in_base_requests_ && !responses_) {
+                        if (key_ == "base_requests") {
+                            in_base_requests_ = true;
+                            return;
+                        }
+                        if (key_ == "stat_requests" && on_stat_requests_) {
+                            ResolveDeferred();
+                            responses_ = on_stat_requests_(root_, is_streamed_);
+                            if (responses_) {
+                                return;
+                            }
+                        }
                     }
-                    else
-                    {
-                        res.push_back(
-                            Builder{}
-                            .StartDict()
-                            .Key("request_id"s).Value(id)
-                            .Key("error_message"s).Value("not found"s)
-                            .EndDict()
-                            .Build()
-                        );
+                    Forward([](json::Handler& value) { value.StartArray(); });
+                }
+
+                void EndArray() override {
+                    if (in_base_requests_ && !IsCapturing()) {
+                        in_base_requests_ = false;
+                        is_streamed_ = true;
+                        return;
                     }
+                    if (responses_ && !IsCapturing() && !are_responses_done_) {
+                        are_responses_done_ = true;
+                        return;
+                    }
+                    Forward([](json::Handler& value) { value.EndArray(); });
+                }
+
+                void Value(Node::Value&& value) override {
+                    Forward([&value](json::Handler& builder) { builder.Value(std::move(value)); });
                 }
-                else if (request.AsDict().at("type").AsString() == "Map") {
-                    auto id = request.AsDict().at("id").AsInt();
-                    svg::Document d = req_hndlr.RenderMap();
-                    std::stringstream out;
-                    d.Render(out);
 
+                // Добавляет запросы, ссылавшиеся на ещё не объявленные остановки, и возвращает
+                // документ без base_requests
+                StreamedInput Finish() {
+                    ResolveDeferred();
+                    if (plain_root_) {
+                        return { Document(value_.Extract()), false, false };
+                    }
+                    return { Document(Node(std::move(root_))), is_streamed_, are_responses_done_ };
+                }
+
+            private:
+                struct DeferredDistance {
+                    std::string from;
+                    std::string to;
+                    int distance;
+                };
+
+                void ResolveDeferred() {
+                    for (const auto& [from, to, distance] : deferred_distances_) {
+                        const auto from_stop = tc_.GetStop(from);
+                        const auto to_stop = tc_.GetStop(to);
+                        tc_.SetDistance(*from_stop, *to_stop, distance);
+                    }
+                    deferred_distances_.clear();
+                    for (const auto& request : deferred_buses_) {
+                        ParseAddBusQuery(request, tc_);
+                    }
+                    deferred_buses_.clear();
+                }
+
+                bool IsCapturing() const {
+                    return depth_ != 1 || capturing_;
+                }
+
+                bool IsInStatRequests() const {
+                    return responses_ && !are_responses_done_;
+                }
+
+                // Передаёт событие сборщику текущего значения; собранный элемент base_requests
+                // сразу применяется к справочнику, значение другого ключа сохраняется.
+                // Элементы stat_requests читаются сразу в типизированные запросы
+                template <typename Event>
+                void Forward(Event event) {
+                    if (depth_ == 0) {
+                        plain_root_ = true;
+                    }
+                    capturing_ = true;
+                    if (IsInStatRequests()) {
+                        event(request_);
+                        if (request_.IsComplete()) {
+                            capturing_ = false;
+                            if (auto request = schema::MakeStatRequest(request_.Extract())) {
+                                responses_->Add(std::move(*request));
+                            }
+                        }
+                        return;
+                    }
+                    event(value_);
+                    if (!value_.IsComplete()) {
+                        return;
+                    }
+                    capturing_ = false;
+                    if (plain_root_) {
+                        return;
+                    }
+                    if (in_base_requests_) {
+                        AddRequest(value_.Extract());
+                    }
+                    else {
+                        root_.emplace(std::move(key_), value_.Extract());
+                    }
+                }
+
+                void AddRequest(Node request) {
+                    const Dict& request_data = request.AsDict();
+                    if (auto stop = ReadStop(request_data)) {
+                        tc_.AddStop(std::move(*stop));
+                        const Stop* from = *tc_.GetStop(request_data.at("name").AsString());
+                        for (const auto& [other_stop, distance] : request_data.at("road_distances").AsDict()) {
+                            if (auto to = tc_.GetStop(other_stop)) {
+                                tc_.SetDistance(from, *to, distance.AsInt());
+                            }
+                            else {
+                                deferred_distances_.push_back({ from->name, other_stop, distance.AsInt() });
+                            }
+                        }
+                    }
+                    else if (request_data.at("type").AsString() == "Bus") {
+                        // Порядок маршрутов сохраняется: после первого отложенного
+                        // откладываются и все следующие
+                        const auto& stops = request_data.at("stops").AsArray();
+                        const bool is_resolved = deferred_buses_.empty() && std::all_of(stops.begin(), stops.end(),
+                            [this](const Node& stop) { return tc_.GetStop(stop.AsString()).has_value(); });
+                        if (is_resolved) {
+                            ParseAddBusQuery(request, tc_);
+                        }
+                        else {
+                            deferred_buses_.push_back(std::move(request));
+                        }
+                    }
+                }
+
+                TransportCatalogue& tc_;
+                const StatRequestsStart& on_stat_requests_;
+                StatResponseStream* responses_ = nullptr;
+                bool are_responses_done_ = false;
+                Dict root_;
+                std::string key_;
+                TreeBuilder value_;
+                schema::StatRequestDecoder request_;
+                // 0 — вне корневого словаря, 1 — внутри него
+                int depth_ = 0;
+                bool capturing_ = false;
+                bool plain_root_ = false;
+                bool in_base_requests_ = false;
+                bool is_streamed_ = false;
+                std::vector<DeferredDistance> deferred_distances_;
+                std::vector<Node> deferred_buses_;
+            };
+        }
+
+        StatResponseStream::StatResponseStream(const RequestHandler& handler, std::ostream& output, size_t window,
+            const json::PrintOptions& options, AllocationCounts* counts)
+            : handler_(&handler)
+            , writer_(output, options)
+            , window_(std::max<size_t>(window, 1))
+            , counts_(counts) {
+            writer_.StartArray();
+            if (window_ > 1) {
+                const size_t workers = std::min<size_t>(window_, std::max(1u, std::thread::hardware_concurrency()));
+                for (size_t i = 0; i < workers; ++i) {
+                    workers_.emplace_back([this] { RunWorker(); });
+                }
+            }
+        }
+
+        StatResponseStream::~StatResponseStream() {
+            StopWorkers();
+        }
+
+        void StatResponseStream::Add(schema::StatRequest request) {
+            if (window_ == 1) {
+                const size_t before = diagnostics::GetThreadAllocationCount();
+                schema::Write(writer_, AnswerStatRequest(request, *handler_, arena_.Get()));
+                arena_.Reset();
+                AddAllocations(counts_, schema::GetTypeName(request), diagnostics::GetThreadAllocationCount() - before);
+                return;
+            }
+            if (pending_.size() == window_) {
+                WriteFront();
+            }
+            std::unique_ptr<RequestArena> arena;
+            if (spare_arenas_.empty()) {
+                arena = std::make_unique<RequestArena>();
+            }
+            else {
+                arena = std::move(spare_arenas_.back());
+                spare_arenas_.pop_back();
+            }
+            const std::string_view type = schema::GetTypeName(request);
+            std::packaged_task<Answer()> task([handler = handler_, request = std::move(request), resource = arena->Get()] {
+                const size_t before = diagnostics::GetThreadAllocationCount();
+                schema::StatResponse response = AnswerStatRequest(request, *handler, resource);
+                return Answer{ std::move(response), diagnostics::GetThreadAllocationCount() - before };
+            });
+            pending_.push_back({ type, std::move(arena), task.get_future() });
+            {
+                std::lock_guard guard(tasks_mutex_);
+                tasks_.push_back(std::move(task));
+            }
+            tasks_ready_.notify_one();
+        }
+
+        void StatResponseStream::Finish() {
+            while (!pending_.empty()) {
+                WriteFront();
+            }
+            StopWorkers();
+            writer_.EndArray();
+            writer_.Flush();
+        }
+
+        void StatResponseStream::RunWorker() {
+            while (true) {
+                std::packaged_task<Answer()> task;
+                {
+                    std::unique_lock lock(tasks_mutex_);
+                    tasks_ready_.wait(lock, [this] { return is_stopping_ || !tasks_.empty(); });
+                    if (tasks_.empty()) {
+                        return;
+                    }
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+                // Исключение при ответе передаётся через future и бросается при выводе ответа
+                task();
+            }
+        }
+
+        void StatResponseStream::StopWorkers() {
+            {
+                std::lock_guard guard(tasks_mutex_);
+                is_stopping_ = true;
+            }
+            tasks_ready_.notify_all();
+            for (std::thread& worker : workers_) {
+                worker.join();
+            }
+            workers_.clear();
+        }
+
+        void StatResponseStream::WriteFront() {
+            Pending& front = pending_.front();
+            const size_t before = diagnostics::GetThreadAllocationCount();
+            {
+                const Answer answer = front.answer.get();
+                schema::Write(writer_, answer.response);
+                AddAllocations(counts_, front.type, answer.allocations + diagnostics::GetThreadAllocationCount() - before);
+            }
+            front.arena->Reset();
+            spare_arenas_.push_back(std::move(front.arena));
+            pending_.pop_front();
+        }
+
+        StreamedInput LoadStreamingBase(std::string_view input, TransportCatalogue& tc, const StatRequestsStart& on_stat_requests) {
+            BaseRequestsReader reader(tc, on_stat_requests);
+            json::Parse(input, reader);
+            return reader.Finish();
+        }
+
+        void ParseBaseRequests(const Array& requests, TransportCatalogue& tc, StageTimings* timings) {
+            ReadBaseRequests(requests, tc, timings);
+        }
+
+        void ParseBaseRequests(const json::arena::Array& requests, TransportCatalogue& tc, StageTimings* timings) {
+            ReadBaseRequests(requests, tc, timings);
+        }
+
+        uint64_t ApplyBaseUpdate(const Array& requests, VersionedCatalogue& versions) {
+            return versions.Update([&requests](TransportCatalogue& tc) { ParseBaseRequests(requests, tc); });
+        }
+
+
+        namespace {
+            struct StatRequestAnswer {
+                const RequestHandler& handler;
+                std::pmr::memory_resource* resource;
+
+                schema::StatResponse operator()(const schema::BusRequest& request) const {
+                    if (auto stat = handler.GetBusStat(request.name, resource)) {
+                        return schema::BusResponse{ stat->curvature, request.id, stat->real_route_lenght,
+                            stat->bus_stops_count, stat->unique_stops_count };
+                    }
+                    return schema::ErrorResponse{ "not found", request.id };
+                }
+
+                schema::StatResponse operator()(const schema::StopRequest& request) const {
+                    if (const auto* buses = handler.GetBusesByStop(request.name)) {
+                        return schema::StopResponse{ { buses->begin(), buses->end(), resource }, request.id };
+                    }
+                    return schema::ErrorResponse{ "not found", request.id };
+                }
+
+                schema::StatResponse operator()(const schema::MapRequest& request) const {
+                    return schema::MapResponse{ handler.GetMap(), request.id };
+                }
+
+                schema::StatResponse operator()(const schema::MapTileRequest& request) const {
+                    if (auto tile = handler.GetMapTile({ request.zoom, request.x, request.y })) {
+                        return schema::MapResponse{ std::move(tile), request.id };
+                    }
+                    return schema::ErrorResponse{ "not found", request.id };
+                }
+
+                schema::StatResponse operator()(const schema::RouteMapRequest& request) const {
+                    if (auto map = handler.GetRouteMap(request.from, request.to, resource)) {
+                        return schema::MapResponse{ std::move(map), request.id };
+                    }
+                    return schema::ErrorResponse{ "not found", request.id };
+                }
+
+                schema::StatResponse operator()(const schema::RouteRequest& request) const {
+                    const auto route = handler.GetRouteInfo(request.from, request.to, resource);
+                    if (!route) {
+                        return schema::ErrorResponse{ "not found", request.id };
+                    }
+                    const int wait_time = handler.GetRoutingSettings().first;
+                    schema::RouteResponse response{ std::pmr::vector<schema::RouteItem>(resource), request.id, route->weight };
+                    response.items.reserve(route->edges.size() * 2);
+                    for (const auto& edge : route->edges) {
+                        response.items.push_back(schema::WaitItem{ edge.from, wait_time });
+                        response.items.push_back(schema::BusItem{ edge.bus, edge.stops_count, edge.weight - wait_time });
+                    }
+                    return response;
+                }
+            };
+        }
+
+        schema::StatResponse AnswerStatRequest(const schema::StatRequest& request, const RequestHandler& req_hndlr,
+            std::pmr::memory_resource* resource) {
+            return std::visit(StatRequestAnswer{ req_hndlr, resource }, request);
+        }
+
+        namespace {
+            // Ответ в виде дерева; промежуточные данные живут в arena до выхода из функции
+            std::optional<Node> AnswerToNode(const Node& request, const RequestHandler& req_hndlr, RequestArena& arena,
+                AllocationCounts* counts) {
+                const size_t before = diagnostics::GetThreadAllocationCount();
+                std::optional<Node> response;
+                std::string_view type;
+                if (auto typed = schema::MakeStatRequest(schema::ReadStatRequestFields(request))) {
+                    type = schema::GetTypeName(*typed);
+                    response = schema::ToNode(AnswerStatRequest(*typed, req_hndlr, arena.Get()));
+                }
+                arena.Reset();
+                if (response) {
+                    AddAllocations(counts, type, diagnostics::GetThreadAllocationCount() - before);
+                }
+                return response;
+            }
+        }
+
+        std::optional<Node> ParseStatRequest(const Node& request, const RequestHandler& req_hndlr) {
+            RequestArena arena;
+            return AnswerToNode(request, req_hndlr, arena, nullptr);
+        }
+
+        std::vector<Node> ParseStatRequests(const Array& stat_requests, const RequestHandler& req_hndlr,
+            AllocationCounts* counts) {
+            std::vector<Node> res;
+            res.reserve(stat_requests.size());
+            RequestArena arena;
+            for (const auto& request : stat_requests) {
+                if (auto response = AnswerToNode(request, req_hndlr, arena, counts)) {
+                    res.push_back(std::move(*response));
+                }
+            }
+            return res;
+        }
+
+        Document HandleStatRequests(const Document& json_req, const RequestHandler& req_hndlr, AllocationCounts* counts) {
+            const Array& stat_requests = json_req.GetRoot().AsDict().at("stat_requests").AsArray();
+            return Document(ParseStatRequests(stat_requests, req_hndlr, counts));
+        }
+
+        TenancySettings ParseTenancySettings(const json::Document& doc) {
+            const json::Dict& tenancy = doc.GetRoot().AsDict().at("tenancy_settings").AsDict();
+            TenancySettings settings;
+            if (auto it = tenancy.find("memory_budget"); it != tenancy.end()) {
+                settings.memory_budget = static_cast<size_t>(it->second.AsDouble());
+            }
+            if (auto it = tenancy.find("report_metrics"); it != tenancy.end()) {
+                settings.report_metrics = it->second.AsBool();
+            }
+            for (const auto& [name, file] : tenancy.at("bases").AsDict()) {
+                settings.bases[name] = file.AsString();
+            }
+            return settings;
+        }
+
+        serialization::SerializationSettings ParseSerializationSettings(const json::Document& doc) {
+            const Dict& serialization = doc.GetRoot().AsDict().at("serialization_settings").AsDict();
+            serialization::SerializationSettings settings;
+            settings.file = serialization.at("file").AsString();
+            if (auto it = serialization.find("delta"); it != serialization.end()) {
+                settings.delta = it->second.AsBool();
+            }
+            if (auto it = serialization.find("max_changes"); it != serialization.end()) {
+                settings.max_changes = it->second.AsInt();
+            }
+            if (auto it = serialization.find("store_map"); it != serialization.end()) {
+                settings.store_map = it->second.AsBool();
+            }
+            return settings;
+        }
+
+        BaseRegistry::LoadedBase LoadBase(const std::string& file) {
+            const io::MappedFile input = io::MappedFile::Open(file);
+            if (serialization::IsBaseFile(input.View())) {
+                return serialization::LoadBaseFile(file);
+            }
+            // Документ нужен только на время загрузки, поэтому он целиком лежит в одной арене
+            const json::arena::Document doc = json::arena::Load(input.View());
+            BaseRegistry::LoadedBase base;
+            ParseRenderSettings(doc, base.renderer);
+            ParseBaseRequests(doc.GetRoot().AsDict().at("base_requests").AsArray(), base.catalogue);
+            base.routing_settings = ParseRoutingSettings(doc);
+            return base;
+        }
+
+        Document HandleStatRequests(const Document& json_req, const RequestHandler* default_handler, BaseRegistry& registry,
+            AllocationCounts* counts) {
+            using namespace std::literals;
+            const Array& stat_requests = json_req.GetRoot().AsDict().at("stat_requests").AsArray();
+            std::vector<Node> res;
+            res.reserve(stat_requests.size());
+            RequestArena arena;
+
+            for (const auto& request : stat_requests) {
+                const Dict& request_data = request.AsDict();
+                std::shared_ptr<const CatalogueSnapshot> snapshot;
+                const RequestHandler* handler = default_handler;
+                if (auto it = request_data.find("base"s); it != request_data.end()) {
+                    snapshot = registry.Acquire(it->second.AsString());
+                    handler = snapshot ? &snapshot->handler : nullptr;
+                }
+
+                if (!handler) {
                     res.push_back(
                         Builder{}
                         .StartDict()
-                        .Key("map"s).Value(out.str())
-                        .Key("request_id"s).Value(id)
+                        .Key("request_id"s).Value(request_data.at("id"s).AsInt())
+                        .Key("error_message"s).Value("not found"s)
                         .EndDict()
                         .Build()
                     );
                 }
-                else if (request.AsDict().at("type").AsString() == "Route") {
-                    auto id = request.AsDict().at("id").AsInt();
-                    std::string from = request.AsDict().at("from"s).AsString();
-                    std::string to = request.AsDict().at("to"s).AsString();
-                    if (auto resp = req_hndlr.GetRouteInfo(from, to)) {
-                        Array arr;
-                        for (const auto& edge : resp->edges){
-                            arr.push_back(
-                                Builder{}
-                                .StartDict()
-                                .Key("stop_name"s).Value(edge.from)
-                                .Key("time"s).Value(req_hndlr.GetRoutingSettings().first)
-                                .Key("type"s).Value("Wait"s)
-                                .EndDict()
-                                .Build()
-                            );
-                            arr.push_back(
-                                Builder{}
-                                .StartDict()
-                                .Key("bus"s).Value(edge.bus)
-                                .Key("span_count"s).Value(edge.stops_count)
-                                .Key("time"s).Value(edge.weight - req_hndlr.GetRoutingSettings().first)
-                                .Key("type"s).Value("Bus")
-                                .EndDict()
-                                .Build()
-                            );
-                        } 
-
-
-                        res.push_back(
-                            Builder{}
-                            .StartDict()
-                            .Key("items"s).Value(arr)
-                            .Key("request_id"s).Value(id)
-                            .Key("total_time"s).Value(resp->weight)
-                            .EndDict()
-                            .Build()
-                        );
-                    }
-                    else
-                    {
-                        res.push_back(
-                            Builder{}
-                            .StartDict()
-                            .Key("request_id"s).Value(id)
-                            .Key("error_message"s).Value("not found"s)
-                            .EndDict()
-                            .Build()
-                        );
-                    }
+                else if (auto response = AnswerToNode(request, *handler, arena, counts)) {
+                    res.push_back(std::move(*response));
                 }
             }
-            return res;
+            return Document(std::move(res));
         }
 
-        Document HandleStatRequests(const Document& json_req, const RequestHandler& req_hndlr) {
-            const Array& stat_requests = json_req.GetRoot().AsDict().at("stat_requests").AsArray();
-            return Document(ParseStatRequests(stat_requests, req_hndlr));
+        StreamingSettings ParseStreamingSettings(const json::Document& doc) {
+            StreamingSettings settings;
+            const Dict& root = doc.GetRoot().AsDict();
+            if (auto it = root.find("streaming_settings"); it != root.end()) {
+                const Dict& streaming = it->second.AsDict();
+                if (auto flag = streaming.find("stat_requests"); flag != streaming.end()) {
+                    settings.stat_requests = flag->second.AsBool();
+                }
+                if (auto window = streaming.find("reorder_window"); window != streaming.end()) {
+                    settings.reorder_window = std::max(window->second.AsInt(), 1);
+                }
+            }
+            return settings;
+        }
+
+        DiagnosticsSettings ParseDiagnosticsSettings(const json::Document& doc) {
+            DiagnosticsSettings settings;
+            const Dict& root = doc.GetRoot().AsDict();
+            if (auto it = root.find("diagnostics_settings"); it != root.end()) {
+                const Dict& diagnostics = it->second.AsDict();
+                if (auto flag = diagnostics.find("build_timings"); flag != diagnostics.end()) {
+                    settings.build_timings = flag->second.AsBool();
+                }
+                if (auto flag = diagnostics.find("allocation_counts"); flag != diagnostics.end()) {
+                    settings.allocation_counts = flag->second.AsBool();
+                }
+            }
+            return settings;
+        }
+
+        json::PrintOptions ParseOutputSettings(const json::Document& doc) {
+            json::PrintOptions options;
+            const Dict& root = doc.GetRoot().AsDict();
+            if (auto it = root.find("output_settings"); it != root.end()) {
+                const Dict& output = it->second.AsDict();
+                if (auto flag = output.find("compact"); flag != output.end()) {
+                    options.compact = flag->second.AsBool();
+                }
+            }
+            return options;
+        }
+
+        Node BuildTimingsReport(const StageTimings& timings) {
+            Dict report;
+            for (const auto& [stage, ms] : timings) {
+                report[stage + "_ms"] = ms;
+            }
+            return Node(std::move(report));
+        }
+
+        Node BuildAllocationReport(const AllocationCounts& counts) {
+            Dict report;
+            for (const auto& [type, count] : counts) {
+                report[type] = Dict{
+                    { "requests", static_cast<int>(count.requests) },
+                    { "allocations", static_cast<double>(count.allocations) },
+                    { "allocations_per_request", static_cast<double>(count.allocations) / count.requests },
+                };
+            }
+            return Node(std::move(report));
+        }
+
+        Node BuildMetricsReport(const BaseRegistry::Metrics& metrics) {
+            using namespace std::literals;
+            return Builder{}
+                .StartDict()
+                .Key("loads"s).Value(static_cast<int>(metrics.loads))
+                .Key("reloads"s).Value(static_cast<int>(metrics.reloads))
+                .Key("router_builds"s).Value(static_cast<int>(metrics.router_builds))
+                .Key("evictions"s).Value(static_cast<int>(metrics.evictions))
+                .Key("router_evictions"s).Value(static_cast<int>(metrics.router_evictions))
+                .Key("load_time_ms"s).Value(metrics.load_time_ms)
+                .Key("max_load_time_ms"s).Value(metrics.max_load_time_ms)
+                .Key("router_build_time_ms"s).Value(metrics.router_build_time_ms)
+                .Key("eviction_time_ms"s).Value(metrics.eviction_time_ms)
+                .Key("resident_bytes"s).Value(static_cast<double>(metrics.resident_bytes))
+                .EndDict()
+                .Build();
         }
     }
 }
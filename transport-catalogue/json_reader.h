@@ -4,17 +4,141 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include "transport_catalogue.h"
+#include "catalogue_snapshot.h"
+#include "base_registry.h"
 #include "request_handler.h"
 #include "json.h"
+#include "json_arena.h"
 #include "map_renderer.h"
+#include "serialization.h"
+#include "stat_schema.h"
+#include "transport_router.h"
 
 namespace transport_catalogue {
     namespace input_parser_reader {
         using namespace json;
         using namespace transport_catalogue::catalogue;
 
-        void ParseBaseRequests(const Document& doc, TransportCatalogue& tc);
+        // Строит справочник по base_requests: сначала все остановки, затем параллельно
+        // расстояния и маршруты. Если timings задан, в него добавляются длительности стадий
+        void ParseBaseRequests(const Document& doc, TransportCatalogue& tc, StageTimings* timings = nullptr);
+
+        void ParseBaseRequests(const Array& requests, TransportCatalogue& tc, StageTimings* timings = nullptr);
+
+        void ParseBaseRequests(const json::arena::Array& requests, TransportCatalogue& tc, StageTimings* timings = nullptr);
+
+        struct StreamingSettings {
+            // stat_requests — отвечать ли на запросы по мере чтения входа. Учитываются только
+            // ключи, стоящие до stat_requests: если среди них нет настроек для построения базы,
+            // ответы не потоковые. При tenancy_settings ответы тоже не потоковые
+            bool stat_requests = false;
+            // reorder_window — сколько запросов может выполняться одновременно
+            size_t reorder_window = std::max(1u, std::thread::hardware_concurrency());
+        };
+
+        StreamingSettings ParseStreamingSettings(const json::Document& doc);
+
+        struct RequestAllocations {
+            size_t requests = 0;
+            size_t allocations = 0;
+        };
+
+        // Выделения памяти при ответах на запросы, по значению поля type
+        using AllocationCounts = std::map<std::string, RequestAllocations, std::less<>>;
+
+        // Отвечает на запросы по одному и сразу выводит ответы. Если окно больше одного,
+        // запросы выполняют рабочие потоки, не больше window и числа ядер, а ответы
+        // выводятся в порядке запросов, так что в памяти одновременно не больше window
+        // запросов. Каждый ответ собирается в своей арене, которая освобождается после его вывода.
+        // Если counts задан, в него добавляются выделения памяти по типам запросов
+        class StatResponseStream {
+        public:
+            StatResponseStream(const RequestHandler& handler, std::ostream& output, size_t window,
+                const json::PrintOptions& options = {}, AllocationCounts* counts = nullptr);
+            StatResponseStream(const StatResponseStream&) = delete;
+            StatResponseStream& operator=(const StatResponseStream&) = delete;
+            ~StatResponseStream();
+
+            // Запрос неизвестного типа не передаётся: ответа на него нет
+            void Add(schema::StatRequest request);
+
+            // Следующие запросы обслуживает handler; уже добавленные выполняются прежним.
+            // Оба должны жить до Finish
+            void SetHandler(const RequestHandler& handler) {
+                handler_ = &handler;
+            }
+
+            // Дожидается оставшихся ответов и закрывает массив
+            void Finish();
+
+        private:
+            struct Answer {
+                schema::StatResponse response;
+                size_t allocations = 0;
+            };
+
+            struct Pending {
+                std::string_view type;
+                std::unique_ptr<RequestArena> arena;
+                std::future<Answer> answer;
+            };
+
+            void WriteFront();
+            void RunWorker();
+            void StopWorkers();
+
+            const RequestHandler* handler_;
+            json::Writer writer_;
+            size_t window_;
+            AllocationCounts* counts_;
+            RequestArena arena_;
+            std::deque<Pending> pending_;
+            // Арены выведенных ответов, готовые для следующих запросов
+            std::vector<std::unique_ptr<RequestArena>> spare_arenas_;
+
+            // Запросы, ещё не взятые рабочими потоками
+            std::deque<std::packaged_task<Answer()>> tasks_;
+            std::mutex tasks_mutex_;
+            std::condition_variable tasks_ready_;
+            bool is_stopping_ = false;
+            std::vector<std::thread> workers_;
+        };
+
+        struct StreamedInput {
+            // Входной документ без base_requests и stat_requests, если они были обработаны при разборе
+            Document doc;
+            bool has_base_requests = false;
+            bool has_streamed_responses = false;
+        };
+
+        // Вызывается, когда разбор дошёл до stat_requests. has_base_requests — были ли до них
+        // base_requests; если были, они уже добавлены в справочник.
+        // По прочитанным к этому моменту ключам возвращает поток ответов или nullptr,
+        // если запросы нужно оставить в документе. Поток закрывает вызывающий: после
+        // stat_requests в него ещё можно добавить ответы на update_requests
+        using StatRequestsStart = std::function<StatResponseStream*(const Dict& root, bool has_base_requests)>;
+
+        // Разбирает входной документ, добавляя элементы base_requests в tc по мере чтения,
+        // без построения дерева для всего массива. Расстояния до остановок, объявленных позже,
+        // и маршруты через такие остановки добавляются в конце base_requests.
+        // Если on_stat_requests вернул поток, элементы stat_requests передаются в него
+        StreamedInput LoadStreamingBase(std::string_view input, TransportCatalogue& tc,
+            const StatRequestsStart& on_stat_requests = {});
+
+        // Применяет запросы Stop и Bus к новой версии базы; текущая версия продолжает
+        // обслуживать запросы, пока новая не опубликована
+        uint64_t ApplyBaseUpdate(const Array& requests, VersionedCatalogue& versions);
 
         void ParseStopQueryCoordinates(const Node& request, TransportCatalogue& tc);
 
@@ -24,11 +148,55 @@ namespace transport_catalogue {
 
         void ParseRenderSettings(const json::Document& doc, renderer::MapRenderer& mr);
 
-        void ParseRoutingSettings(const json::Document& doc);
+        void ParseRenderSettings(const json::arena::Document& doc, renderer::MapRenderer& mr);
+
+        RoutingSettings ParseRoutingSettings(const json::Document& doc);
+
+        RoutingSettings ParseRoutingSettings(const json::arena::Document& doc);
+
+        Document HandleStatRequests(const Document& json_req, const transport_catalogue::RequestHandler& req_hndlr,
+            AllocationCounts* counts = nullptr);
+
+        TenancySettings ParseTenancySettings(const json::Document& doc);
+
+        serialization::SerializationSettings ParseSerializationSettings(const json::Document& doc);
+
+        // Загружает базу из файла make_base или из JSON-файла с ключами base_requests,
+        // render_settings и routing_settings
+        BaseRegistry::LoadedBase LoadBase(const std::string& file);
+
+        // Запрос с ключом base обслуживается соответствующей базой из registry,
+        // остальные — default_handler, если он задан
+        Document HandleStatRequests(const Document& json_req, const RequestHandler* default_handler, BaseRegistry& registry,
+            AllocationCounts* counts = nullptr);
+
+        Node BuildMetricsReport(const BaseRegistry::Metrics& metrics);
+
+        struct DiagnosticsSettings {
+            // build_timings — выводить ли в stderr длительности стадий построения базы
+            bool build_timings = false;
+            // allocation_counts — выводить ли в stderr число выделений памяти по типам запросов
+            bool allocation_counts = false;
+        };
+
+        DiagnosticsSettings ParseDiagnosticsSettings(const json::Document& doc);
+
+        // Параметры вывода ответов из output_settings, например {"compact": true}
+        json::PrintOptions ParseOutputSettings(const json::Document& doc);
+
+        Node BuildTimingsReport(const StageTimings& timings);
+
+        Node BuildAllocationReport(const AllocationCounts& counts);
+
+        std::vector<Node> ParseStatRequests(const Array& stat_requests, const RequestHandler& req_hndlr,
+            AllocationCounts* counts = nullptr);
 
-        Document HandleStatRequests(const Document& json_req, const transport_catalogue::RequestHandler& req_hndlr);
+        // Массивы ответа размещаются в resource, строки ссылаются на базу req_hndlr
+        schema::StatResponse AnswerStatRequest(const schema::StatRequest& request, const RequestHandler& req_hndlr,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-        std::vector<Node> ParseStatRequests(const Array& stat_requests, const RequestHandler& req_hndlr);
+        // Ответ на один запрос к базе; для запроса неизвестного типа ответа нет
+        std::optional<Node> ParseStatRequest(const Node& request, const RequestHandler& req_hndlr);
     }
 }
 
@@ -1,6 +1,13 @@
 #include "json_reader.h"
 #include "request_handler.h"
 #include "transport_router.h"
+#include "catalogue_snapshot.h"
+#include "base_registry.h"
+#include "mapped_file.h"
+#include "serialization.h"
+#include <chrono>
+#include <future>
+#include <optional>
 #include <sstream>
 
 using namespace transport_catalogue;
@@ -8,21 +15,193 @@ using namespace transport_catalogue::input_parser_reader;
 using namespace transport_catalogue::renderer;
 
 using namespace std;
-int main() {
+
+namespace {
+    double ElapsedMs(chrono::steady_clock::time_point since) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+    }
+
+    enum class Stage {
+        // База строится из base_requests и сразу отвечает на stat_requests
+        FULL,
+        // База строится и сохраняется в файл serialization_settings
+        MAKE_BASE,
+        // База читается из файла serialization_settings и отвечает на stat_requests
+        PROCESS_REQUESTS,
+    };
+}
+
+int main(int argc, char* argv[]) {
+    const auto start = chrono::steady_clock::now();
+    Stage stage = Stage::FULL;
+    if (argc == 2 && argv[1] == "make_base"sv) {
+        stage = Stage::MAKE_BASE;
+    }
+    else if (argc == 2 && argv[1] == "process_requests"sv) {
+        stage = Stage::PROCESS_REQUESTS;
+    }
+    else if (argc != 1) {
+        std::cerr << "Usage: transport_catalogue [make_base|process_requests]" << std::endl;
+        return 1;
+    }
+    StageTimings timings;
+
+    // base_requests добавляются в справочник во время разбора, в документе их не остаётся
     TransportCatalogue tc;
+    // Собственная база запроса обслуживает запросы без ключа base
+    optional<VersionedCatalogue> versions;
+    shared_ptr<const CatalogueSnapshot> snapshot;
+    optional<StatResponseStream> responses;
+    // Заполняется, только если diagnostics_settings.allocation_counts включён
+    AllocationCounts allocation_counts;
+    AllocationCounts* counts = nullptr;
+
+    auto build_base = [&](const Document& settings, bool has_base_requests) {
+        if (stage == Stage::PROCESS_REQUESTS) {
+            BaseRegistry::LoadedBase base = serialization::LoadBaseFile(ParseSerializationSettings(settings).file);
+            timings.emplace_back("load_base_file", ElapsedMs(start));
+            versions.emplace(std::move(base.catalogue), std::move(base.renderer), base.routing_settings, &timings,
+                std::move(base.routes), std::move(base.map));
+            snapshot = versions->Acquire();
+        }
+        else if (has_base_requests) {
+            MapRenderer map_rdr;
+            ParseRenderSettings(settings, map_rdr);
+
+            versions.emplace(std::move(tc), std::move(map_rdr), ParseRoutingSettings(settings), &timings);
+            snapshot = versions->Acquire();
+        }
+        timings.emplace_back("build_total", ElapsedMs(start));
+        const DiagnosticsSettings diagnostics = ParseDiagnosticsSettings(settings);
+        if (diagnostics.build_timings) {
+            Print(Document(BuildTimingsReport(timings)), std::cerr);
+            std::cerr << std::endl;
+        }
+        if (diagnostics.allocation_counts) {
+            counts = &allocation_counts;
+        }
+    };
+
+    // update_requests: каждый элемент применяет свои base_requests к новой версии собственной
+    // базы и задаёт stat_requests к опубликованной ею версии. Изменения применяются в фоне,
+    // пока идут ответы на основные stat_requests: их обслуживает снимок, полученный до
+    // изменений, поэтому ответы от изменений не зависят и читатели не ждут писателя
+    future<vector<shared_ptr<const CatalogueSnapshot>>> updates;
+    auto start_updates = [&](const Dict& root) {
+        const auto it = root.find("update_requests");
+        if (it == root.end() || !versions) {
+            return;
+        }
+        updates = async(launch::async, [&update_requests = it->second.AsArray(), &versions] {
+            vector<shared_ptr<const CatalogueSnapshot>> published;
+            for (const Node& update : update_requests) {
+                ApplyBaseUpdate(update.AsDict().at("base_requests").AsArray(), *versions);
+                published.push_back(versions->Acquire());
+            }
+            return published;
+        });
+    };
+    // Вызывает answer(stat_requests, snapshot) для каждого элемента update_requests
+    // и снимка, опубликованного им
+    auto for_each_update = [&](const Dict& root, const auto& answer) {
+        if (!updates.valid()) {
+            return;
+        }
+        const Array& update_requests = root.at("update_requests").AsArray();
+        const auto published = updates.get();
+        for (size_t i = 0; i < published.size(); ++i) {
+            const Dict& update = update_requests[i].AsDict();
+            if (const auto it = update.find("stat_requests"); it != update.end()) {
+                answer(it->second.AsArray(), published[i]);
+            }
+        }
+    };
 
-    Document doc(Load(cin));
-    MapRenderer map_rdr;
-    ParseRenderSettings(doc, map_rdr);
+    auto report_allocations = [&] {
+        if (counts) {
+            Print(Document(BuildAllocationReport(allocation_counts)), std::cerr);
+            std::cerr << std::endl;
+        }
+    };
 
-    ParseBaseRequests(doc, tc);
-  
-    ParseRoutingSettings(doc);
+    // В потоковом режиме база строится по ключам, прочитанным до stat_requests,
+    // и ответы выводятся, пока запросы ещё читаются. Если base_requests или настройки,
+    // нужные для построения базы, идут после stat_requests, запросы читаются целиком, как без потока
+    auto start_responses = [&](const Dict& root, bool has_base_requests) -> StatResponseStream* {
+        const Document settings{Node(root)};
+        const StreamingSettings streaming = ParseStreamingSettings(settings);
+        if (stage == Stage::MAKE_BASE || !streaming.stat_requests || root.count("tenancy_settings")) {
+            return nullptr;
+        }
+        const bool has_settings = stage == Stage::PROCESS_REQUESTS
+            ? root.count("serialization_settings") > 0
+            : has_base_requests && root.count("render_settings") > 0 && root.count("routing_settings") > 0;
+        if (!has_settings) {
+            return nullptr;
+        }
+        timings.emplace_back("load_json_and_base", ElapsedMs(start));
+        build_base(settings, true);
+        return &responses.emplace(snapshot->handler, std::cout, streaming.reorder_window, ParseOutputSettings(settings), counts);
+    };
 
-    TransportRouter tr(tc);
+    auto [doc, has_base_requests, has_streamed_responses] = [&] {
+        const io::MappedFile input = io::MappedFile::FromStdin();
+        return LoadStreamingBase(input.View(), tc, start_responses);
+    }();
+    if (has_streamed_responses) {
+        const Dict& root = doc.GetRoot().AsDict();
+        start_updates(root);
+        // Снимки живут, пока не выведены все ответы
+        vector<shared_ptr<const CatalogueSnapshot>> answered;
+        for_each_update(root, [&](const Array& stat_requests, const shared_ptr<const CatalogueSnapshot>& published) {
+            answered.push_back(published);
+            responses->SetHandler(published->handler);
+            for (const Node& request : stat_requests) {
+                if (auto typed = schema::MakeStatRequest(schema::ReadStatRequestFields(request))) {
+                    responses->Add(std::move(*typed));
+                }
+            }
+        });
+        responses->Finish();
+        report_allocations();
+        return 0;
+    }
+    timings.emplace_back("load_json_and_base", ElapsedMs(start));
+    const Dict& root = doc.GetRoot().AsDict();
+    const PrintOptions output_options = ParseOutputSettings(doc);
 
-    RequestHandler req_hndlr( tc, map_rdr, tr );
+    if (root.count("base_requests")) {
+        // base_requests не массив: ParseBaseRequests сообщит об ошибке так же, как раньше
+        ParseBaseRequests(doc, tc, &timings);
+    }
+    if (stage == Stage::MAKE_BASE) {
+        MapRenderer map_rdr;
+        ParseRenderSettings(doc, map_rdr);
+        serialization::MakeBase(ParseSerializationSettings(doc), tc, map_rdr, ParseRoutingSettings(doc));
+        return 0;
+    }
+    build_base(doc, has_base_requests);
 
+    if (root.count("tenancy_settings")) {
+        TenancySettings settings = ParseTenancySettings(doc);
+        const bool report_metrics = settings.report_metrics;
+        BaseRegistry registry(std::move(settings), LoadBase);
 
-    Print(HandleStatRequests(doc, req_hndlr), std::cout);
-}
\ No newline at end of file
+        Print(HandleStatRequests(doc, snapshot ? &snapshot->handler : nullptr, registry, counts), std::cout, output_options);
+        if (report_metrics) {
+            Print(Document(BuildMetricsReport(registry.GetMetrics())), std::cerr);
+            std::cerr << std::endl;
+        }
+    }
+    else {
+        start_updates(root);
+        vector<Node> answers = ParseStatRequests(root.at("stat_requests").AsArray(), snapshot->handler, counts);
+        for_each_update(root, [&](const Array& stat_requests, const shared_ptr<const CatalogueSnapshot>& published) {
+            for (Node& answer : ParseStatRequests(stat_requests, published->handler, counts)) {
+                answers.push_back(std::move(answer));
+            }
+        });
+        Print(Document(std::move(answers)), std::cout, output_options);
+    }
+    report_allocations();
+}
@@ -0,0 +1,672 @@
+#include "map_renderer.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace transport_catalogue::renderer {
+
+    namespace {
+
+        // Сколько готовых плиток хранится в кеше одной версии базы
+        const size_t MAX_CACHED_TILES = 1024;
+
+        const uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+        // Верхняя оценка ширины символа надписи в долях размера шрифта
+        const double MAX_GLYPH_WIDTH = 1.0;
+
+        struct Rect {
+            double min_x = 0;
+            double min_y = 0;
+            double max_x = 0;
+            double max_y = 0;
+
+            Rect Expanded(double dx, double dy) const {
+                return { min_x - dx, min_y - dy, max_x + dx, max_y + dy };
+            }
+        };
+
+        Rect PointBounds(svg::Point point) {
+            return { point.x, point.y, point.x, point.y };
+        }
+
+        // Размеры надписи или круга вокруг опорной точки, в пикселях изображения
+        struct Extent {
+            double left = 0;
+            double top = 0;
+            double right = 0;
+            double bottom = 0;
+
+            void Extend(const Extent& other) {
+                left = std::max(left, other.left);
+                top = std::max(top, other.top);
+                right = std::max(right, other.right);
+                bottom = std::max(bottom, other.bottom);
+            }
+        };
+
+        // Равномерная сетка над изображением: в ячейке хранятся номера элементов,
+        // рамки которых её пересекают
+        class Grid {
+        public:
+            Grid(double width, double height, size_t item_count) {
+                // В среднем несколько элементов на ячейку
+                side_ = std::clamp<size_t>(static_cast<size_t>(std::sqrt(static_cast<double>(item_count) / 4)), 1, 1024);
+                cell_width_ = std::max(width, 1.0) / side_;
+                cell_height_ = std::max(height, 1.0) / side_;
+                cells_.resize(side_ * side_);
+            }
+
+            void Add(uint32_t id, const Rect& bounds) {
+                const auto [x0, y0, x1, y1] = CellRange(bounds);
+                for (size_t y = y0; y <= y1; ++y) {
+                    for (size_t x = x0; x <= x1; ++x) {
+                        cells_[y * side_ + x].push_back(id);
+                    }
+                }
+            }
+
+            // Номера элементов, которые могут пересекать area, по возрастанию и без повторов
+            std::vector<uint32_t> Query(const Rect& area) const {
+                std::vector<uint32_t> ids;
+                const auto [x0, y0, x1, y1] = CellRange(area);
+                for (size_t y = y0; y <= y1; ++y) {
+                    for (size_t x = x0; x <= x1; ++x) {
+                        const auto& cell = cells_[y * side_ + x];
+                        ids.insert(ids.end(), cell.begin(), cell.end());
+                    }
+                }
+                std::sort(ids.begin(), ids.end());
+                ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+                return ids;
+            }
+
+            size_t EstimateMemoryUsage() const {
+                size_t bytes = cells_.capacity() * sizeof(std::vector<uint32_t>);
+                for (const auto& cell : cells_) {
+                    bytes += cell.capacity() * sizeof(uint32_t);
+                }
+                return bytes;
+            }
+
+        private:
+            // Ячейки вне изображения прижимаются к его краю
+            size_t CellIndex(double coordinate, double cell_size) const {
+                const double cell = std::floor(coordinate / cell_size);
+                if (!(cell > 0)) {
+                    return 0;
+                }
+                return std::min(static_cast<size_t>(std::min(cell, static_cast<double>(side_))), side_ - 1);
+            }
+
+            std::tuple<size_t, size_t, size_t, size_t> CellRange(const Rect& area) const {
+                return { CellIndex(area.min_x, cell_width_), CellIndex(area.min_y, cell_height_),
+                    CellIndex(area.max_x, cell_width_), CellIndex(area.max_y, cell_height_) };
+            }
+
+            size_t side_ = 1;
+            double cell_width_ = 1;
+            double cell_height_ = 1;
+            std::vector<std::vector<uint32_t>> cells_;
+        };
+
+        // Отсекает отрезок [from, to] прямоугольником area (алгоритм Лианга — Барски).
+        // Возвращает доли отрезка, с которых начинается и на которых кончается видимая часть
+        std::optional<std::pair<double, double>> ClipSegment(svg::Point from, svg::Point to, const Rect& area) {
+            double t0 = 0;
+            double t1 = 1;
+            const double dx = to.x - from.x;
+            const double dy = to.y - from.y;
+            const double p[] = { -dx, dx, -dy, dy };
+            const double q[] = { from.x - area.min_x, area.max_x - from.x, from.y - area.min_y, area.max_y - from.y };
+            for (int i = 0; i < 4; ++i) {
+                if (p[i] == 0) {
+                    if (q[i] < 0) {
+                        return std::nullopt;
+                    }
+                    continue;
+                }
+                const double t = q[i] / p[i];
+                if (p[i] < 0) {
+                    t0 = std::max(t0, t);
+                }
+                else {
+                    t1 = std::min(t1, t);
+                }
+            }
+            if (t0 > t1) {
+                return std::nullopt;
+            }
+            return std::pair{ t0, t1 };
+        }
+
+        svg::Point Interpolate(svg::Point from, svg::Point to, double t) {
+            return { from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t };
+        }
+
+    }
+
+    namespace {
+
+        // Квадрат расстояния от точки до отрезка [from, to]
+        double SquaredDistanceToSegment(svg::Point point, svg::Point from, svg::Point to) {
+            const double dx = to.x - from.x;
+            const double dy = to.y - from.y;
+            const double length = dx * dx + dy * dy;
+            double t = 0;
+            if (length > 0) {
+                t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length, 0.0, 1.0);
+            }
+            const double x = from.x + dx * t - point.x;
+            const double y = from.y + dy * t - point.y;
+            return x * x + y * y;
+        }
+
+    }
+
+    std::vector<svg::Point> SimplifyPolyline(const std::vector<svg::Point>& points, double tolerance) {
+        if (points.size() < 3) {
+            return points;
+        }
+        const double squared_tolerance = tolerance * tolerance;
+        std::vector<bool> keep(points.size());
+        keep.front() = true;
+        keep.back() = true;
+        // Отрезки ломаной, которые ещё предстоит проверить; рекурсия заменена стеком
+        std::vector<std::pair<size_t, size_t>> ranges{ { 0, points.size() - 1 } };
+        while (!ranges.empty()) {
+            const auto [first, last] = ranges.back();
+            ranges.pop_back();
+            double max_distance = 0;
+            size_t farthest = first;
+            for (size_t i = first + 1; i < last; ++i) {
+                const double distance = SquaredDistanceToSegment(points[i], points[first], points[last]);
+                if (distance > max_distance) {
+                    max_distance = distance;
+                    farthest = i;
+                }
+            }
+            if (max_distance > squared_tolerance) {
+                keep[farthest] = true;
+                ranges.emplace_back(first, farthest);
+                ranges.emplace_back(farthest, last);
+            }
+        }
+        std::vector<svg::Point> result;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (keep[i]) {
+                result.push_back(points[i]);
+            }
+        }
+        return result;
+    }
+
+    std::vector<uint32_t> ClusterPoints(const std::vector<svg::Point>& points, double cell_size) {
+        // Точки упорядочиваются по ячейке, а внутри ячейки — по номеру
+        std::vector<std::tuple<double, double, uint32_t>> cells;
+        cells.reserve(points.size());
+        for (uint32_t i = 0; i < points.size(); ++i) {
+            cells.emplace_back(std::floor(points[i].x / cell_size), std::floor(points[i].y / cell_size), i);
+        }
+        std::sort(cells.begin(), cells.end());
+        std::vector<uint32_t> result;
+        for (size_t i = 0; i < cells.size(); ++i) {
+            const auto& [x, y, id] = cells[i];
+            if (i == 0 || x != std::get<0>(cells[i - 1]) || y != std::get<1>(cells[i - 1])) {
+                result.push_back(id);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    struct MapTiles::Index {
+        Index(double width_, double height_, size_t label_count)
+            : width(width_)
+            , height(height_)
+            , bus_label_grid(width_, height_, label_count) {
+        }
+
+        // Отрезок линии line между вершинами from и to; у линии из одной вершины from == to
+        struct Segment {
+            uint32_t line = 0;
+            uint32_t from = 0;
+            uint32_t to = 0;
+        };
+
+        // Вершины и отрезки всех линий одного уровня детализации
+        struct Lines {
+            Lines(double width, double height, size_t point_count)
+                : grid(width, height, point_count) {
+            }
+
+            size_t EstimateMemoryUsage() const {
+                return sizeof(Lines) + points.capacity() * sizeof(svg::Point) + segments.capacity() * sizeof(Segment)
+                    + grid.EstimateMemoryUsage();
+            }
+
+            std::vector<svg::Point> points;
+            std::vector<Segment> segments;
+            Grid grid;
+        };
+
+        // Надпись с названием маршрута bus у одной из его конечных
+        struct BusLabel {
+            svg::Point position;
+            uint32_t bus = 0;
+            Extent extent;
+        };
+
+        struct StopMark {
+            svg::Point position;
+            const Stop* stop = nullptr;
+            Extent label_extent;
+        };
+
+        // Остановки, которые рисуются на одном уровне масштаба, и сетка над ними
+        struct Stops {
+            Stops(double width, double height, size_t stop_count)
+                : grid(width, height, stop_count) {
+            }
+
+            size_t EstimateMemoryUsage() const {
+                return sizeof(Stops) + marks.capacity() * sizeof(StopMark) + grid.EstimateMemoryUsage();
+            }
+
+            std::vector<StopMark> marks;
+            Grid grid;
+        };
+
+        // Линии для плиток уровня zoom, упрощённые с допуском tolerance пикселей плитки.
+        // Каждый уровень строится один раз, при первом запросе; без упрощения все уровни
+        // пользуются одними линиями
+        const Lines& GetLines(int zoom, double tolerance) const {
+            const int level = tolerance > 0 ? zoom : 0;
+            std::call_once(lines_once[level], [&] {
+                const double map_tolerance = std::ldexp(tolerance, -level);
+                size_t point_count = 0;
+                for (const auto& route : routes) {
+                    point_count += route.size();
+                }
+                auto result = std::make_unique<Lines>(width, height, point_count);
+                result->points.reserve(point_count);
+                for (uint32_t line = 0; line < routes.size(); ++line) {
+                    const uint32_t first = static_cast<uint32_t>(result->points.size());
+                    if (map_tolerance > 0) {
+                        const std::vector<svg::Point> simplified = SimplifyPolyline(routes[line], map_tolerance);
+                        result->points.insert(result->points.end(), simplified.begin(), simplified.end());
+                    }
+                    else {
+                        result->points.insert(result->points.end(), routes[line].begin(), routes[line].end());
+                    }
+                    const uint32_t count = static_cast<uint32_t>(result->points.size()) - first;
+                    for (uint32_t i = 0; i + 1 < std::max<uint32_t>(count, 2); ++i) {
+                        const uint32_t from = first + i;
+                        const uint32_t to = count > 1 ? from + 1 : from;
+                        const svg::Point a = result->points[from];
+                        const svg::Point b = result->points[to];
+                        result->grid.Add(static_cast<uint32_t>(result->segments.size()),
+                            { std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x), std::max(a.y, b.y) });
+                        result->segments.push_back({ line, from, to });
+                    }
+                }
+                memory_usage += result->EstimateMemoryUsage();
+                lines[level] = std::move(result);
+            });
+            return *lines[level];
+        }
+
+        // Остановки для плиток уровня zoom: по одной от каждого скопления в ячейке со стороной
+        // cluster_size пикселей плитки. Как и линии, уровень строится при первом запросе
+        const Stops& GetStops(int zoom, double cluster_size) const {
+            const int level = cluster_size > 0 ? zoom : 0;
+            std::call_once(stops_once[level], [&] {
+                std::vector<uint32_t> ids;
+                if (cluster_size > 0) {
+                    std::vector<svg::Point> points;
+                    points.reserve(stops.size());
+                    for (const StopMark& mark : stops) {
+                        points.push_back(mark.position);
+                    }
+                    ids = ClusterPoints(points, std::ldexp(cluster_size, -level));
+                }
+                else {
+                    ids.resize(stops.size());
+                    std::iota(ids.begin(), ids.end(), 0);
+                }
+                auto result = std::make_unique<Stops>(width, height, ids.size());
+                result->marks.reserve(ids.size());
+                for (uint32_t id : ids) {
+                    result->grid.Add(static_cast<uint32_t>(result->marks.size()), PointBounds(stops[id].position));
+                    result->marks.push_back(stops[id]);
+                }
+                memory_usage += result->EstimateMemoryUsage();
+                stop_levels[level] = std::move(result);
+            });
+            return *stop_levels[level];
+        }
+
+        double width = 0;
+        double height = 0;
+
+        // Маршруты в порядке отрисовки; номер линии совпадает с номером маршрута
+        std::vector<const Bus*> buses;
+        // Вершины линий в полной детализации
+        std::vector<std::vector<svg::Point>> routes;
+        std::vector<BusLabel> bus_labels;
+        // Все остановки по возрастанию имён
+        std::vector<StopMark> stops;
+
+        // Наибольшие размеры элементов вокруг опорных точек
+        Extent bus_label_extent;
+        Extent stop_extent;
+        Extent stop_label_extent;
+
+        Grid bus_label_grid;
+
+        mutable std::array<std::once_flag, MAX_TILE_ZOOM + 1> lines_once;
+        mutable std::array<std::unique_ptr<const Lines>, MAX_TILE_ZOOM + 1> lines;
+        mutable std::array<std::once_flag, MAX_TILE_ZOOM + 1> stops_once;
+        mutable std::array<std::unique_ptr<const Stops>, MAX_TILE_ZOOM + 1> stop_levels;
+        // Память индекса вместе с построенными уровнями
+        mutable std::atomic<size_t> memory_usage{ 0 };
+    };
+
+    namespace {
+
+        // Рамка надписи из name.size() символов вокруг опорной точки, с подложкой
+        Extent LabelExtent(std::string_view name, const std::array<double, 2>& offset, int font_size, double underlayer_width) {
+            const double margin = underlayer_width / 2;
+            const double width = static_cast<double>(name.size()) * font_size * MAX_GLYPH_WIDTH;
+            Extent extent;
+            extent.left = std::max(0.0, -offset[0]) + margin;
+            extent.right = std::max(0.0, offset[0] + width) + margin;
+            extent.top = std::max(0.0, font_size - offset[1]) + margin;
+            extent.bottom = std::max(0.0, offset[1] + font_size) + margin;
+            return extent;
+        }
+
+    }
+
+    MapTiles::MapTiles(const MapRenderer& renderer, std::vector<const Bus*> buses)
+        : renderer_(renderer)
+        , buses_(std::move(buses)) {
+    }
+
+    MapTiles::~MapTiles() = default;
+
+    const MapTiles::Index& MapTiles::GetIndex() const {
+        std::call_once(index_once_, [this] {
+            const auto& props = renderer_.props;
+            MapRenderer::Scene scene = renderer_.MakeScene(buses_);
+            auto index = std::make_unique<Index>(props.width, props.height, scene.buses.size() * 2);
+
+            index->routes.reserve(scene.buses.size());
+            for (uint32_t line = 0; line < scene.buses.size(); ++line) {
+                const Bus* bus = scene.buses[line];
+                const auto [route_begin, route_end] = scene.GetRoute(line);
+                auto& route = index->routes.emplace_back(route_end - route_begin);
+                std::transform(route_begin, route_end, route.begin(), [&scene](uint32_t stop) { return scene.points[stop]; });
+
+                MapRenderer::ForEachBusLabel(scene, line, [&](uint32_t stop) {
+                    const Index::BusLabel label{ scene.points[stop], line,
+                        LabelExtent(bus->name, props.bus_label_offset, props.bus_label_font_size, props.underlayer_width) };
+                    index->bus_label_extent.Extend(label.extent);
+                    index->bus_label_grid.Add(static_cast<uint32_t>(index->bus_labels.size()), PointBounds(label.position));
+                    index->bus_labels.push_back(label);
+                });
+            }
+
+            index->stop_extent = { props.stop_radius, props.stop_radius, props.stop_radius, props.stop_radius };
+            index->stops.reserve(scene.stops.size());
+            for (uint32_t id = 0; id < scene.stops.size(); ++id) {
+                const Stop* stop = scene.stops[id];
+                const Index::StopMark mark{ scene.points[id], stop,
+                    LabelExtent(stop->name, props.stop_label_offset, props.stop_label_font_size, props.underlayer_width) };
+                index->stop_label_extent.Extend(mark.label_extent);
+                index->stops.push_back(mark);
+            }
+            index->buses = std::move(scene.buses);
+
+            size_t bytes = sizeof(Index) + index->buses.capacity() * sizeof(const Bus*)
+                + index->routes.capacity() * sizeof(std::vector<svg::Point>)
+                + index->bus_labels.capacity() * sizeof(Index::BusLabel)
+                + index->stops.capacity() * sizeof(Index::StopMark) + index->bus_label_grid.EstimateMemoryUsage();
+            for (const auto& route : index->routes) {
+                bytes += route.capacity() * sizeof(svg::Point);
+            }
+            index->memory_usage += bytes;
+            index_ = std::move(index);
+            built_index_ = index_.get();
+        });
+        return *index_;
+    }
+
+    std::shared_ptr<const json::PreparedString> MapTiles::GetTile(TileKey key) const {
+        if (key.zoom < 0 || key.zoom > MAX_TILE_ZOOM || key.x < 0 || key.y < 0
+            || key.x >= (1 << key.zoom) || key.y >= (1 << key.zoom)) {
+            return nullptr;
+        }
+        const std::tuple cache_key{ key.zoom, key.x, key.y };
+        {
+            std::lock_guard guard(cache_mutex_);
+            if (auto it = cache_.find(cache_key); it != cache_.end()) {
+                return it->second;
+            }
+        }
+
+        std::string svg;
+        RenderTile(GetIndex(), key).Render(svg);
+        auto tile = std::make_shared<const json::PreparedString>(std::move(svg));
+
+        std::lock_guard guard(cache_mutex_);
+        // Плитку мог параллельно нарисовать другой поток; в кеше остаётся первая
+        const auto [it, inserted] = cache_.emplace(cache_key, tile);
+        if (inserted) {
+            cache_order_.push_back(cache_key);
+            cache_bytes_ += TileMemoryUsage(*tile);
+            if (cache_order_.size() > MAX_CACHED_TILES) {
+                const auto oldest = cache_.find(cache_order_.front());
+                cache_bytes_ -= TileMemoryUsage(*oldest->second);
+                cache_.erase(oldest);
+                cache_order_.pop_front();
+            }
+        }
+        return it->second;
+    }
+
+    size_t MapTiles::EstimateMemoryUsage() const {
+        const Index* index = built_index_;
+        std::lock_guard guard(cache_mutex_);
+        return (index ? index->memory_usage.load() : 0) + cache_bytes_;
+    }
+
+    size_t MapTiles::TileMemoryUsage(const json::PreparedString& tile) {
+        // Плитка, узел кеша и её ключ в очереди вытеснения
+        return sizeof(json::PreparedString) + tile.Get().capacity() + tile.GetLiteral().size()
+            + sizeof(std::tuple<int, int, int>) * 2 + sizeof(std::shared_ptr<const json::PreparedString>) + 4 * sizeof(void*);
+    }
+
+    svg::Document MapTiles::RenderTile(const Index& index, TileKey key) const {
+        const auto& props = renderer_.props;
+        const double scale = std::ldexp(1.0, key.zoom);
+        const double tile_width = index.width / scale;
+        const double tile_height = index.height / scale;
+        // Область плитки в координатах карты
+        const Rect tile{ key.x * tile_width, key.y * tile_height, (key.x + 1) * tile_width, (key.y + 1) * tile_height };
+        const Rect image{ 0, 0, index.width, index.height };
+
+        // Точка карты на изображении плитки
+        auto to_tile = [&](svg::Point point) {
+            return svg::Point{ (point.x - tile.min_x) * scale, (point.y - tile.min_y) * scale };
+        };
+        // Пересекает ли изображение плитки рамка extent вокруг точки
+        auto is_visible = [&](svg::Point position, const Extent& extent) {
+            return position.x + extent.right >= image.min_x && position.x - extent.left <= image.max_x
+                && position.y + extent.bottom >= image.min_y && position.y - extent.top <= image.max_y;
+        };
+        // Область карты, в которой лежат опорные точки элементов, видимых на плитке
+        auto query_area = [&](const Extent& extent) {
+            return Rect{ tile.min_x - extent.right / scale, tile.min_y - extent.bottom / scale,
+                tile.max_x + extent.left / scale, tile.max_y + extent.top / scale };
+        };
+
+        svg::Document map;
+
+        // Линии обрезаются по краю плитки с запасом на половину толщины; соседние
+        // видимые отрезки одной линии собираются в одну ломаную
+        const std::vector<svg::Document::StyleId> line_styles = renderer_.AddLineStyles(map);
+        const Index::Lines& lines = index.GetLines(key.zoom, props.line_tolerance);
+        const Rect clip_area = tile.Expanded(props.line_width / 2 / scale, props.line_width / 2 / scale);
+        std::vector<svg::Point> polyline;
+        uint32_t polyline_line = 0;
+        // Номер последней вершины ломаной, если ломаная кончается в вершине линии, иначе NO_VERTEX
+        uint32_t open_end = NO_VERTEX;
+        auto flush = [&] {
+            if (!polyline.empty()) {
+                map.AddPolyline(polyline, line_styles[polyline_line % line_styles.size()]);
+                polyline.clear();
+            }
+            open_end = NO_VERTEX;
+        };
+        for (uint32_t id : lines.grid.Query(clip_area)) {
+            const Index::Segment& segment = lines.segments[id];
+            const svg::Point from = lines.points[segment.from];
+            const svg::Point to = lines.points[segment.to];
+            const auto clipped = ClipSegment(from, to, clip_area);
+            if (!clipped) {
+                continue;
+            }
+            const auto [t0, t1] = *clipped;
+            const bool continues = segment.line == polyline_line && open_end == segment.from && t0 == 0;
+            if (!continues) {
+                flush();
+                polyline_line = segment.line;
+                polyline.push_back(to_tile(t0 == 0 ? from : Interpolate(from, to, t0)));
+            }
+            if (segment.to != segment.from) {
+                polyline.push_back(to_tile(t1 == 1 ? to : Interpolate(from, to, t1)));
+            }
+            if (t1 == 1) {
+                open_end = segment.to;
+            }
+            else {
+                flush();
+            }
+        }
+        flush();
+
+        const MapRenderer::LabelStyles bus_label_styles = renderer_.AddBusLabelStyles(map);
+        for (uint32_t id : index.bus_label_grid.Query(query_area(index.bus_label_extent))) {
+            const Index::BusLabel& label = index.bus_labels[id];
+            const svg::Point position = to_tile(label.position);
+            if (is_visible(position, label.extent)) {
+                const std::string& name = index.buses[label.bus]->name;
+                map.AddText(position, name, bus_label_styles.underlayer);
+                map.AddText(position, name, bus_label_styles.text[label.bus % bus_label_styles.text.size()]);
+            }
+        }
+
+        const Index::Stops& stops = index.GetStops(key.zoom, props.stop_cluster_size);
+        const svg::Document::StyleId stop_style = renderer_.AddStopStyle(map);
+        for (uint32_t id : stops.grid.Query(query_area(index.stop_extent))) {
+            const svg::Point position = to_tile(stops.marks[id].position);
+            if (is_visible(position, index.stop_extent)) {
+                map.AddCircle(position, props.stop_radius, stop_style);
+            }
+        }
+
+        const MapRenderer::LabelStyles stop_label_styles = renderer_.AddStopLabelStyles(map);
+        for (uint32_t id : stops.grid.Query(query_area(index.stop_label_extent))) {
+            const Index::StopMark& mark = stops.marks[id];
+            const svg::Point position = to_tile(mark.position);
+            if (is_visible(position, mark.label_extent)) {
+                map.AddText(position, mark.stop->name, stop_label_styles.underlayer);
+                map.AddText(position, mark.stop->name, stop_label_styles.text.front());
+            }
+        }
+        return map;
+    }
+
+    RouteMaps::RouteMaps(const MapRenderer& renderer, std::vector<const Bus*> buses)
+        : renderer_(renderer)
+        , buses_(std::move(buses)) {
+    }
+
+    const MapRenderer::Scene& RouteMaps::GetScene() const {
+        std::call_once(scene_once_, [this] {
+            scene_ = renderer_.MakeScene(buses_);
+            scene_bytes_ = scene_->buses.capacity() * sizeof(const Bus*) + scene_->stops.capacity() * sizeof(const Stop*)
+                + scene_->points.capacity() * sizeof(svg::Point) + scene_->route_stops.capacity() * sizeof(uint32_t)
+                + scene_->route_offsets.capacity() * sizeof(uint32_t);
+        });
+        return *scene_;
+    }
+
+    size_t RouteMaps::EstimateMemoryUsage() const {
+        return scene_bytes_;
+    }
+
+    std::shared_ptr<const json::PreparedString> RouteMaps::Render(const json::PreparedString& map, const std::vector<RouteSpan>& spans) const {
+        const auto& props = renderer_.props;
+        const MapRenderer::Scene& scene = GetScene();
+
+        svg::Document overlay;
+        const svg::Document::StyleId casing_style = overlay.AddStyle(svg::PathStyle().
+            SetStrokeColor(props.underlayer_color).
+            SetFillColor("none").SetStrokeWidth(props.line_width + 2 * props.underlayer_width).
+            SetStrokeLineJoin(svg::StrokeLineJoin::ROUND).
+            SetStrokeLineCap(svg::StrokeLineCap::ROUND));
+        const std::vector<svg::Document::StyleId> line_styles = renderer_.AddLineStyles(overlay);
+
+        // Участки маршрута: номер автобуса в сцене и отрезок его полного прохода
+        struct Segment {
+            size_t bus = 0;
+            const uint32_t* begin = nullptr;
+            const uint32_t* end = nullptr;
+        };
+        std::vector<Segment> segments;
+        segments.reserve(spans.size());
+        // Остановки, где начинаются и кончаются поездки, в порядке маршрута
+        std::vector<uint32_t> stops;
+        for (const RouteSpan& span : spans) {
+            const auto bus_it = std::lower_bound(scene.buses.begin(), scene.buses.end(), span.bus,
+                [](const Bus* bus, std::string_view name) { return bus->name < name; });
+            if (bus_it == scene.buses.end() || (*bus_it)->name != span.bus || span.span_count < 0) {
+                continue;
+            }
+            const size_t bus = bus_it - scene.buses.begin();
+            const auto [route_begin, route_end] = scene.GetRoute(bus);
+            const size_t count = static_cast<size_t>(span.span_count);
+            // Поездка — первый отрезок прохода, который начинается в from и через count перегонов приходит в to
+            for (const uint32_t* it = route_begin; static_cast<size_t>(route_end - it) > count; ++it) {
+                if (scene.stops[*it]->name == span.from && scene.stops[it[count]]->name == span.to) {
+                    segments.push_back({ bus, it, it + count + 1 });
+                    if (stops.empty() || stops.back() != *it) {
+                        stops.push_back(*it);
+                    }
+                    stops.push_back(it[count]);
+                    break;
+                }
+            }
+        }
+
+        std::vector<svg::Point> points;
+        for (const bool is_casing : { true, false }) {
+            for (const Segment& segment : segments) {
+                points.resize(segment.end - segment.begin);
+                std::transform(segment.begin, segment.end, points.begin(), [&scene](uint32_t stop) { return scene.points[stop]; });
+                overlay.AddPolyline(points, is_casing ? casing_style : line_styles[segment.bus % line_styles.size()]);
+            }
+        }
+        renderer_.RenderStops(overlay, scene, stops, 0, stops.size());
+        renderer_.RenderStopNames(overlay, scene, stops, 0, stops.size());
+
+        std::string text;
+        overlay.RenderElements(text);
+        return std::make_shared<const json::PreparedString>(map.Insert(svg::Document::END_TAG.size(), text));
+    }
+
+}
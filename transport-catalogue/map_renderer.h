@@ -5,12 +5,21 @@
 #include "json.h"
 #include "domain.h"
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <mutex>
 #include <optional>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <array>
-#include <set>
 
 namespace transport_catalogue {
 
@@ -22,6 +31,16 @@ namespace transport_catalogue {
             return std::abs(value) < transport_catalogue::renderer::EPSILON;
         }
 
+        // Упрощает ломаную алгоритмом Дугласа — Пекера: оставляет концы и те вершины, без которых
+        // ломаная отклонилась бы от исходной больше чем на tolerance
+        std::vector<svg::Point> SimplifyPolyline(const std::vector<svg::Point>& points, double tolerance);
+
+        // Объединяет точки, попавшие в одну ячейку сетки со стороной cell_size с началом в (0, 0):
+        // от каждой ячейки остаётся первая из её точек. Возвращает номера оставшихся точек по
+        // возрастанию. Ячейки вдвое меньшей сетки вложены в ячейки исходной, поэтому скопления
+        // на соседних уровнях масштаба образуют иерархию
+        std::vector<uint32_t> ClusterPoints(const std::vector<svg::Point>& points, double cell_size);
+
         class SphereProjector {
         public:
             // points_begin и points_end задают начало и конец интервала элементов geo::Coordinates
@@ -96,137 +115,210 @@ namespace transport_catalogue {
 
         struct MapRenderer {
 
-            void RenderLines(svg::Document& map, std::vector<std::vector<const Stop*>> buses_stops, const SphereProjector& proj) const {
-                for (const auto& stops : buses_stops) {
-                    svg::Polyline bus_line;
+            // Маршруты в порядке отрисовки и их остановки. Номер остановки сцены — её место
+            // в stops; по этим номерам все слои берут готовые проекции остановок из points
+            struct Scene {
+                std::vector<const Bus*> buses;
+                // Остановки маршрутов по возрастанию имён
+                std::vector<const Stop*> stops;
+                // Проекции остановок на изображение
+                std::vector<svg::Point> points;
+                // Номера остановок полного прохода маршрута buses[i] — отрезок
+                // [route_offsets[i], route_offsets[i + 1]) массива route_stops
+                std::vector<uint32_t> route_stops;
+                std::vector<uint32_t> route_offsets;
+
+                // Номера остановок полного прохода маршрута
+                std::pair<const uint32_t*, const uint32_t*> GetRoute(size_t bus) const {
+                    return { route_stops.data() + route_offsets[bus], route_stops.data() + route_offsets[bus + 1] };
+                }
+            };
 
-                    for (const auto& stop : stops) {
-                        bus_line.AddPoint(proj(stop->coordinates));
+            // Надписи рисуются поверх подложки того же шрифта
+            struct LabelStyles {
+                svg::Document::StyleId underlayer = 0;
+                // Стиль надписи для каждого цвета палитры; у названий остановок он один
+                std::vector<svg::Document::StyleId> text;
+            };
+
+            Scene MakeScene(std::vector<const Bus*> buses) const {
+                Scene scene;
+                std::sort(buses.begin(), buses.end(), [](const Bus* lhs, const Bus* rhs) { return lhs->name < rhs->name; });
+                scene.stops = CollectStops(buses);
+
+                // Все остановки проецируются одним проходом по массиву координат
+                std::vector<geo::Coordinates> coords(scene.stops.size());
+                std::transform(scene.stops.begin(), scene.stops.end(), coords.begin(), [](const Stop* stop) { return stop->coordinates; });
+                const SphereProjector projector{ coords.begin(), coords.end(), props.width, props.height, props.padding };
+                scene.points.resize(coords.size());
+                std::transform(coords.begin(), coords.end(), scene.points.begin(), projector);
+
+                std::unordered_map<const Stop*, uint32_t> stop_ids;
+                stop_ids.reserve(scene.stops.size());
+                for (uint32_t id = 0; id < scene.stops.size(); ++id) {
+                    stop_ids.emplace(scene.stops[id], id);
+                }
+                scene.route_offsets.reserve(buses.size() + 1);
+                scene.route_offsets.push_back(0);
+                for (const Bus* bus : buses) {
+                    const size_t forward = scene.route_stops.size();
+                    for (const Stop* stop : bus->stops) {
+                        scene.route_stops.push_back(stop_ids.at(stop));
                     }
-                    bus_line.SetStrokeColor(GetColor(map.Size())).
-                        SetFillColor("none").SetStrokeWidth(props.line_width).
-                        SetStrokeLineJoin(svg::StrokeLineJoin::ROUND).
-                        SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-                    map.Add(bus_line);
+                    // Обратное направление некольцевого маршрута: A B C -> A B C B A
+                    if (!bus->is_loop && !bus->stops.empty()) {
+                        for (size_t i = bus->stops.size() - 1; i-- > 0;) {
+                            scene.route_stops.push_back(scene.route_stops[forward + i]);
+                        }
+                    }
+                    scene.route_offsets.push_back(static_cast<uint32_t>(scene.route_stops.size()));
                 }
+                scene.buses = std::move(buses);
+                return scene;
+            }
 
+            // Номера остановок, которые рисуются на карте: все остановки сцены, а если задан
+            // stop_cluster_size — первая по имени остановка каждого скопления
+            std::vector<uint32_t> GetVisibleStops(const Scene& scene) const {
+                if (props.stop_cluster_size > 0) {
+                    return ClusterPoints(scene.points, props.stop_cluster_size);
+                }
+                std::vector<uint32_t> stops(scene.stops.size());
+                std::iota(stops.begin(), stops.end(), 0);
+                return stops;
             }
 
-            void RenderBusNames(svg::Document& map, std::vector<const Bus*> all_buses, const SphereProjector& proj) const {
-                int color_count = 0;
-                for (auto bus : all_buses) {
-                    if (bus->is_loop) {
-                        
-                        svg::Text bus_label;
-                        geo::Coordinates geo_label_coord = bus->stops.front()->coordinates;
-                        bus_label.
-                            SetFillColor(GetColor(color_count++)).
-                            SetPosition(proj(geo_label_coord)).
-                            SetOffset({props.bus_label_offset[0], props.bus_label_offset[1]}).
-                            SetFontSize(props.bus_label_font_size).
-                            SetFontFamily("Verdana").
-                            SetFontWeight("bold").
-                            SetData(bus->name);
-                        
-                        svg::Text bus_label_underlayer = bus_label;     
-                        bus_label_underlayer.
-                            SetFillColor(props.underlayer_color).
-                            SetStrokeColor(props.underlayer_color).
-                            SetStrokeWidth(props.underlayer_width).
-                            SetStrokeLineCap(svg::StrokeLineCap::ROUND).
-                            SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-                        map.Add(bus_label_underlayer);
-                        map.Add(bus_label);
-                    }
-                    else
-                    { 
-                        svg::Text bus_label;
-                        geo::Coordinates geo_label_coord = bus->stops.front()->coordinates;
-                        bus_label.
-                            SetFillColor(GetColor(color_count++)).
-                            SetPosition(proj(geo_label_coord)).
-                            SetOffset({ props.bus_label_offset[0], props.bus_label_offset[1] }).
-                            SetFontSize(props.bus_label_font_size).
-                            SetFontFamily("Verdana").
-                            SetFontWeight("bold").
-                            SetData(bus->name);
-
-                        svg::Text bus_label_underlayer = bus_label;
-                        bus_label_underlayer.
-                            SetFillColor(props.underlayer_color).
-                            SetStrokeColor(props.underlayer_color).
-                            SetStrokeWidth(props.underlayer_width).
-                            SetStrokeLineCap(svg::StrokeLineCap::ROUND).
-                            SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-                        map.Add(bus_label_underlayer);
-                        map.Add(bus_label);
-
-                        if (bus->stops.front() != bus->stops.at(bus->stops.size() / 2)) {                           
-                        geo_label_coord = bus->stops.at(bus->stops.size()/2)->coordinates;
-
-                        bus_label.SetPosition(proj(geo_label_coord));
-                        bus_label_underlayer.SetPosition(proj(geo_label_coord));
-
-                        map.Add(bus_label_underlayer);
-                        map.Add(bus_label);
-                        } 
-                        
+            // Остановки маршрутов по возрастанию имён, без повторов
+            static std::vector<const Stop*> CollectStops(const std::vector<const Bus*>& all_buses) {
+                std::vector<const Stop*> stops;
+                for (const Bus* bus : all_buses) {
+                    stops.insert(stops.end(), bus->stops.begin(), bus->stops.end());
+                }
+                std::sort(stops.begin(), stops.end(), [](const Stop* lhs, const Stop* rhs) { return lhs->name < rhs->name; });
+                stops.erase(std::unique(stops.begin(), stops.end(), [](const Stop* lhs, const Stop* rhs) { return lhs->name == rhs->name; }),
+                    stops.end());
+                return stops;
+            }
 
+            // Слои карты рисуются частями: каждая функция ниже добавляет к map элементы
+            // [first, last) своего слоя. Цвет линии и названия маршрута зависит от номера
+            // маршрута во всём списке, поэтому части можно рисовать в разные документы
+
+            void RenderLines(svg::Document& map, const Scene& scene, size_t first, size_t last) const {
+                const std::vector<svg::Document::StyleId> styles = AddLineStyles(map);
+                std::vector<svg::Point> points;
+                for (size_t i = first; i < last; ++i) {
+                    const auto [route_begin, route_end] = scene.GetRoute(i);
+                    points.resize(route_end - route_begin);
+                    std::transform(route_begin, route_end, points.begin(), [&scene](uint32_t stop) { return scene.points[stop]; });
+                    if (props.line_tolerance > 0) {
+                        points = SimplifyPolyline(points, props.line_tolerance);
                     }
+                    map.AddPolyline(points, styles[i % styles.size()]);
                 }
             }
 
-            void RenderStops(svg::Document& map, std::vector<const Bus*> all_buses, const SphereProjector& proj) const {
-                auto Pr = [](const Stop* lhs, const Stop* rhs) { return lhs->name < rhs->name; };
-                std::set<const Stop*, decltype(Pr)> stops(Pr);
-                for (const Bus* bus : all_buses) {
-                    stops.insert(bus->stops.begin(), bus->stops.end());
+            void RenderBusNames(svg::Document& map, const Scene& scene, size_t first, size_t last) const {
+                const LabelStyles styles = AddBusLabelStyles(map);
+                for (size_t i = first; i < last; ++i) {
+                    const std::string& name = scene.buses[i]->name;
+                    const svg::Document::StyleId style = styles.text[i % styles.text.size()];
+                    ForEachBusLabel(scene, i, [&](uint32_t stop) {
+                        map.AddText(scene.points[stop], name, styles.underlayer);
+                        map.AddText(scene.points[stop], name, style);
+                    });
                 }
+            }
 
-                for (const auto& stop : stops) {
-                    svg::Circle stop_circle;
-                    stop_circle.
-                        SetCenter(proj(stop->coordinates)).
-                        SetRadius(props.stop_radius).
-                        SetFillColor("white");
-                    map.Add(stop_circle);
+            // stops — номера остановок сцены, например из GetVisibleStops
+            void RenderStops(svg::Document& map, const Scene& scene, const std::vector<uint32_t>& stops,
+                size_t first, size_t last) const {
+                const svg::Document::StyleId style = AddStopStyle(map);
+                for (size_t i = first; i < last; ++i) {
+                    map.AddCircle(scene.points[stops[i]], props.stop_radius, style);
                 }
             }
 
-            void RenderStopNames(svg::Document& map, std::vector<const Bus*> all_buses, const SphereProjector& proj) const {
-                auto Pr = [](const Stop* lhs, const Stop* rhs) { return lhs->name < rhs->name; };
-                std::set<const Stop*, decltype(Pr)> stops(Pr);
-                for (const Bus* bus : all_buses) {
-                    stops.insert(bus->stops.begin(), bus->stops.end());
+            void RenderStopNames(svg::Document& map, const Scene& scene, const std::vector<uint32_t>& stops,
+                size_t first, size_t last) const {
+                const LabelStyles styles = AddStopLabelStyles(map);
+                for (size_t i = first; i < last; ++i) {
+                    const std::string& name = scene.stops[stops[i]]->name;
+                    map.AddText(scene.points[stops[i]], name, styles.underlayer);
+                    map.AddText(scene.points[stops[i]], name, styles.text.front());
+                }
+            }
+
+            // Вызывает action для номеров конечных, у которых подписывается маршрут scene.buses[bus]:
+            // у кольцевого маршрута и маршрута с одинаковыми конечными это одна остановка
+            template <typename Action>
+            static void ForEachBusLabel(const Scene& scene, size_t bus, Action&& action) {
+                const Bus& route = *scene.buses[bus];
+                const uint32_t* stops = scene.route_stops.data() + scene.route_offsets[bus];
+                action(stops[0]);
+                if (!route.is_loop && route.stops.front() != route.stops.back()) {
+                    action(stops[route.stops.size() - 1]);
                 }
+            }
 
-                for (const auto& stop : stops) {
-                    svg::Text stop_label;
-
-                    stop_label.
-                        SetFillColor("black").
-                        SetPosition(proj(stop->coordinates)).
-                        SetOffset({ props.stop_label_offset[0], props.stop_label_offset[1] }).
-                        SetFontSize(props.stop_label_font_size).
-                        SetFontFamily("Verdana").
-                        SetData(stop->name);
-
-                    svg::Text stop_label_underlayer = stop_label;
-                    stop_label_underlayer.
-                        SetFillColor(props.underlayer_color).
-                        SetStrokeColor(props.underlayer_color).
-                        SetStrokeWidth(props.underlayer_width).
-                        SetStrokeLineCap(svg::StrokeLineCap::ROUND).
-                        SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-                    map.Add(stop_label_underlayer);
-                    map.Add(stop_label); 
-                }           
+            // Линии различаются только цветом: по стилю на каждый цвет палитры
+            std::vector<svg::Document::StyleId> AddLineStyles(svg::Document& map) const {
+                std::vector<svg::Document::StyleId> styles;
+                styles.reserve(props.color_palette.size());
+                for (const svg::Color& color : props.color_palette) {
+                    styles.push_back(map.AddStyle(svg::PathStyle().
+                        SetStrokeColor(color).
+                        SetFillColor("none").SetStrokeWidth(props.line_width).
+                        SetStrokeLineJoin(svg::StrokeLineJoin::ROUND).
+                        SetStrokeLineCap(svg::StrokeLineCap::ROUND)));
+                }
+                return styles;
             }
 
-            svg::Color GetColor(int num) const {
-                return props.color_palette[num % props.color_palette.size()];
+            LabelStyles AddBusLabelStyles(svg::Document& map) const {
+                svg::TextStyle label;
+                label.
+                    SetOffset({ props.bus_label_offset[0], props.bus_label_offset[1] }).
+                    SetFontSize(props.bus_label_font_size).
+                    SetFontFamily("Verdana").
+                    SetFontWeight("bold");
+                LabelStyles styles;
+                styles.underlayer = map.AddStyle(MakeUnderlayerStyle(label));
+                styles.text.reserve(props.color_palette.size());
+                for (const svg::Color& color : props.color_palette) {
+                    svg::TextStyle style = label;
+                    styles.text.push_back(map.AddStyle(style.SetFillColor(color)));
+                }
+                return styles;
             }
+
+            svg::Document::StyleId AddStopStyle(svg::Document& map) const {
+                return map.AddStyle(svg::PathStyle().SetFillColor("white"));
+            }
+
+            LabelStyles AddStopLabelStyles(svg::Document& map) const {
+                svg::TextStyle label;
+                label.
+                    SetOffset({ props.stop_label_offset[0], props.stop_label_offset[1] }).
+                    SetFontSize(props.stop_label_font_size).
+                    SetFontFamily("Verdana");
+                LabelStyles styles;
+                styles.underlayer = map.AddStyle(MakeUnderlayerStyle(label));
+                styles.text.push_back(map.AddStyle(label.SetFillColor("black")));
+                return styles;
+            }
+
+            // Подложка надписи: тот же шрифт, залитый и обведённый цветом подложки
+            svg::TextStyle MakeUnderlayerStyle(svg::TextStyle label) const {
+                label.
+                    SetFillColor(props.underlayer_color).
+                    SetStrokeColor(props.underlayer_color).
+                    SetStrokeWidth(props.underlayer_width).
+                    SetStrokeLineCap(svg::StrokeLineCap::ROUND).
+                    SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+                return label;
+            }
+
             struct VisualiseProps {
 
                 //width и height — ширина и высота изображения в пикселях. Вещественное число в диапазоне от 0 до 100000.
@@ -263,9 +355,101 @@ namespace transport_catalogue {
 
                 //color_palette - цветовая палитра. Непустой массив.
                 std::vector<svg::Color> color_palette;
+
+                //line_tolerance — допуск упрощения линий маршрутов в пикселях изображения. Вершины, без которых
+                //линия отклоняется не больше чем на допуск, не выводятся. Необязательный; 0 — линии выводятся точно.
+                double line_tolerance = 0;
+
+                //stop_cluster_size — сторона ячейки, в которой остановки объединяются в одну, в пикселях изображения.
+                //От ячейки рисуется одна остановка с одной надписью. Необязательный; 0 — рисуются все остановки.
+                double stop_cluster_size = 0;
             };
             VisualiseProps props;
         };
 
+        // Плитка карты: на уровне zoom изображение делится на 2^zoom × 2^zoom плиток,
+        // x и y — номера столбца и строки плитки, считая от левого верхнего угла
+        struct TileKey {
+            int zoom = 0;
+            int x = 0;
+            int y = 0;
+        };
+
+        inline constexpr int MAX_TILE_ZOOM = 20;
+
+        // Рисует плитки карты. Плитка — часть карты, растянутая на всё изображение;
+        // толщина линий, радиусы и шрифты при этом не меняются. Остановки, надписи и
+        // отрезки линий ищутся по сетке над изображением, в плитку попадает только то,
+        // что в ней видно, а линии обрезаются по её краю. Плитка 0/0/0 совпадает с картой.
+        // Готовые плитки кешируются; объект можно использовать из нескольких потоков
+        class MapTiles {
+        public:
+            // Настройки и маршруты должны жить, пока существует объект
+            MapTiles(const MapRenderer& renderer, std::vector<const Bus*> buses);
+            ~MapTiles();
+
+            // nullptr, если плитки с такими координатами нет
+            std::shared_ptr<const json::PreparedString> GetTile(TileKey key) const;
+
+            // Приблизительный объём памяти индекса и закешированных плиток. Растёт по мере запросов
+            size_t EstimateMemoryUsage() const;
+
+        private:
+            // Проекции элементов карты и сетки над ними; строится при первом запросе плитки
+            struct Index;
+
+            const Index& GetIndex() const;
+            svg::Document RenderTile(const Index& index, TileKey key) const;
+            static size_t TileMemoryUsage(const json::PreparedString& tile);
+
+            const MapRenderer& renderer_;
+            std::vector<const Bus*> buses_;
+            mutable std::once_flag index_once_;
+            mutable std::unique_ptr<const Index> index_;
+            // Индекс, если он уже построен: его можно прочитать, не дожидаясь построения
+            mutable std::atomic<const Index*> built_index_{ nullptr };
+
+            mutable std::mutex cache_mutex_;
+            mutable std::map<std::tuple<int, int, int>, std::shared_ptr<const json::PreparedString>> cache_;
+            // Ключи кеша в порядке добавления: при переполнении вытесняется самая старая плитка
+            mutable std::deque<std::tuple<int, int, int>> cache_order_;
+            mutable size_t cache_bytes_ = 0;
+        };
+
+        // Поездка найденного маршрута: автобус bus от остановки from до остановки to,
+        // span_count перегонов подряд по его маршруту
+        struct RouteSpan {
+            std::string_view bus;
+            std::string_view from;
+            std::string_view to;
+            int span_count = 0;
+        };
+
+        // Рисует карты с выделенным маршрутом. На запрос рисуются только участки маршрута
+        // и его остановки, а их текст вставляется в готовую карту сети перед закрывающим тегом. Участки обведены цветом подложки и
+        // нарисованы цветом автобуса, остановки пересадок подписаны. Объект можно
+        // использовать из нескольких потоков
+        class RouteMaps {
+        public:
+            // Настройки и маршруты должны жить, пока существует объект
+            RouteMaps(const MapRenderer& renderer, std::vector<const Bus*> buses);
+
+            // map — карта сети, нарисованная по тем же настройкам и маршрутам
+            std::shared_ptr<const json::PreparedString> Render(const json::PreparedString& map, const std::vector<RouteSpan>& spans) const;
+
+            // Приблизительный объём памяти сцены; ответы не кешируются и в него не входят
+            size_t EstimateMemoryUsage() const;
+
+        private:
+            // Сцена строится при первом запросе
+            const MapRenderer::Scene& GetScene() const;
+
+            const MapRenderer& renderer_;
+            std::vector<const Bus*> buses_;
+            mutable std::once_flag scene_once_;
+            mutable std::optional<MapRenderer::Scene> scene_;
+            mutable std::atomic<size_t> scene_bytes_{ 0 };
+        };
+
     }
 }
\ No newline at end of file
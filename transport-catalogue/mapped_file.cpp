@@ -0,0 +1,114 @@
+#include "mapped_file.h"
+
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_HAS_MMAP 1
+#else
+#include <fstream>
+#endif
+
+namespace io {
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Release();
+            is_mapped_ = std::exchange(other.is_mapped_, false);
+            size_ = std::exchange(other.size_, 0);
+            buffer_ = std::move(other.buffer_);
+            data_ = is_mapped_ ? std::exchange(other.data_, nullptr) : buffer_.data();
+            other.data_ = nullptr;
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        Release();
+    }
+
+    void MappedFile::Release() {
+#ifdef MAPPED_FILE_HAS_MMAP
+        if (is_mapped_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        is_mapped_ = false;
+        buffer_.clear();
+    }
+
+#ifdef MAPPED_FILE_HAS_MMAP
+
+    MappedFile MappedFile::FromDescriptor(int fd) {
+        MappedFile file;
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                file.data_ = static_cast<const char*>(data);
+                file.size_ = static_cast<size_t>(info.st_size);
+                file.is_mapped_ = true;
+                return file;
+            }
+        }
+
+        // Канал или устройство: читаем всё, что удастся
+        char chunk[1 << 16];
+        for (ssize_t read_bytes; (read_bytes = read(fd, chunk, sizeof(chunk))) > 0;) {
+            file.buffer_.append(chunk, static_cast<size_t>(read_bytes));
+        }
+        file.data_ = file.buffer_.data();
+        file.size_ = file.buffer_.size();
+        return file;
+    }
+
+    MappedFile MappedFile::Open(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Can't open file " + path);
+        }
+        MappedFile file = FromDescriptor(fd);
+        close(fd);
+        return file;
+    }
+
+    MappedFile MappedFile::FromStdin() {
+        return FromDescriptor(STDIN_FILENO);
+    }
+
+#else
+
+    MappedFile MappedFile::Open(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Can't open file " + path);
+        }
+        MappedFile file;
+        file.buffer_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        file.data_ = file.buffer_.data();
+        file.size_ = file.buffer_.size();
+        return file;
+    }
+
+    MappedFile MappedFile::FromStdin() {
+        MappedFile file;
+        file.buffer_.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        file.data_ = file.buffer_.data();
+        file.size_ = file.buffer_.size();
+        return file;
+    }
+
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace io {
+
+    // Содержимое файла, отображённое в память только для чтения. Если отобразить
+    // не удаётся (канал, терминал, платформа без mmap), данные читаются в буфер
+    class MappedFile {
+    public:
+        // Бросает std::runtime_error, если файл не удаётся открыть
+        static MappedFile Open(const std::string& path);
+
+        // Стандартный ввод; перенаправленный из файла ввод отображается без копирования
+        static MappedFile FromStdin();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        std::string_view View() const {
+            return { data_, size_ };
+        }
+
+    private:
+        MappedFile() = default;
+
+        static MappedFile FromDescriptor(int fd);
+        void Release();
+
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        bool is_mapped_ = false;
+        std::string buffer_;
+    };
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace graph {
+
+// Маршрутизатор для графа, разбитого на регионы. Таблица кратчайших путей строится
+// для каждого региона отдельно (параллельно), а пути между регионами ищутся по
+// небольшому графу-надстройке над граничными вершинами. Граничная вершина —
+// начало или конец ребра, соединяющего разные регионы.
+//
+// Вес любого пути совпадает с весом, который дал бы Router для всего графа:
+// путь между регионами разбивается на участок внутри региона отправления до первой
+// граничной вершины, путь по надстройке и участок внутри региона прибытия, а
+// надстройка содержит межрегиональные рёбра и кратчайшие пути между граничными
+// вершинами каждого региона.
+template <typename Weight>
+class PartitionedRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using RouteTable = typename Router<Weight>::RouteTable;
+    // Готовая таблица для маршрутизатора с номером index в порядке GetRouters, построенного
+    // по графу graph, или nullptr, если таблицу нужно построить
+    using TableSource = std::function<RouteTable(size_t index, const Graph& graph)>;
+
+    // region_of[v] — номер региона вершины v, от 0 до region_count - 1. Таблицы, которые
+    // отдаёт tables, не строятся: так перестраиваются только изменившиеся регионы
+    PartitionedRouter(const Graph& graph, std::vector<size_t> region_of, size_t region_count,
+                      const TableSource& tables = nullptr);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // Маршрутизаторы регионов по порядку, затем маршрутизатор надстройки
+    std::vector<const Router<Weight>*> GetRouters() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr VertexId NONE = std::numeric_limits<VertexId>::max();
+    // Начиная с такого числа граничных вершин участки в регионах отправления
+    // и прибытия считаются параллельно
+    static constexpr size_t PARALLEL_LEG_THRESHOLD = 256;
+
+    struct Region {
+        std::vector<VertexId> vertices;  // локальный номер -> номер в исходном графе
+        std::vector<EdgeId> edges;       // локальное ребро -> ребро исходного графа
+        std::vector<VertexId> boundary;  // локальные номера граничных вершин
+        Graph graph;
+        std::optional<Router<Weight>> router;
+    };
+
+    // Ребро надстройки: либо ребро исходного графа между регионами,
+    // либо кратчайший путь внутри региона между его граничными вершинами
+    struct OverlayEdge {
+        bool is_shortcut;
+        EdgeId edge;
+        size_t region;
+        VertexId from;
+        VertexId to;
+    };
+
+    struct Leg {
+        VertexId boundary;
+        Weight weight;
+    };
+
+    void BuildRegions(const TableSource& tables);
+    void BuildOverlay(const TableSource& tables);
+
+    std::vector<Leg> LegsFrom(VertexId from) const;
+    std::vector<Leg> LegsTo(VertexId to) const;
+    void AppendLocalRoute(const Region& region, VertexId from, VertexId to, std::vector<EdgeId>& edges) const;
+
+    const Graph& graph_;
+    std::vector<size_t> region_of_;
+    std::vector<VertexId> local_id_;
+    std::vector<Region> regions_;
+
+    std::vector<VertexId> overlay_id_;       // вершина исходного графа -> вершина надстройки
+    std::vector<VertexId> overlay_vertices_; // вершина надстройки -> вершина исходного графа
+    std::vector<OverlayEdge> overlay_edges_;
+    Graph overlay_graph_;
+    std::optional<Router<Weight>> overlay_router_;
+};
+
+template <typename Weight>
+PartitionedRouter<Weight>::PartitionedRouter(const Graph& graph, std::vector<size_t> region_of, size_t region_count,
+                                             const TableSource& tables)
+    : graph_(graph)
+    , region_of_(std::move(region_of))
+    , local_id_(graph.GetVertexCount())
+    , regions_(region_count)
+    , overlay_id_(graph.GetVertexCount(), NONE)
+{
+    BuildRegions(tables);
+    BuildOverlay(tables);
+}
+
+template <typename Weight>
+std::vector<const Router<Weight>*> PartitionedRouter<Weight>::GetRouters() const {
+    std::vector<const Router<Weight>*> routers;
+    routers.reserve(regions_.size() + 1);
+    for (const Region& region : regions_) {
+        routers.push_back(&*region.router);
+    }
+    routers.push_back(&*overlay_router_);
+    return routers;
+}
+
+template <typename Weight>
+void PartitionedRouter<Weight>::BuildRegions(const TableSource& tables) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        Region& region = regions_.at(region_of_[vertex]);
+        local_id_[vertex] = region.vertices.size();
+        region.vertices.push_back(vertex);
+    }
+    for (Region& region : regions_) {
+        region.graph = Graph(region.vertices.size());
+    }
+
+    std::vector<bool> is_boundary(vertex_count);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (region_of_[edge.from] == region_of_[edge.to]) {
+            Region& region = regions_[region_of_[edge.from]];
+            // Название маршрута локальному графу не нужно: путь восстанавливается по исходным рёбрам
+            region.graph.AddEdge({{}, local_id_[edge.from], local_id_[edge.to], edge.weight, edge.stops_count});
+            region.edges.push_back(edge_id);
+        } else {
+            is_boundary[edge.from] = true;
+            is_boundary[edge.to] = true;
+        }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        if (is_boundary[vertex]) {
+            regions_[region_of_[vertex]].boundary.push_back(local_id_[vertex]);
+        }
+    }
+
+    std::vector<std::future<void>> builds;
+    builds.reserve(regions_.size());
+    for (size_t region_id = 0; region_id < regions_.size(); ++region_id) {
+        Region& region = regions_[region_id];
+        if (RouteTable table = tables ? tables(region_id, region.graph) : nullptr) {
+            region.router.emplace(region.graph, table);
+            continue;
+        }
+        builds.push_back(std::async(std::launch::async, [&region] {
+            region.router.emplace(region.graph);
+        }));
+    }
+    for (auto& build : builds) {
+        build.get();
+    }
+}
+
+template <typename Weight>
+void PartitionedRouter<Weight>::BuildOverlay(const TableSource& tables) {
+    for (const Region& region : regions_) {
+        for (VertexId local : region.boundary) {
+            overlay_id_[region.vertices[local]] = overlay_vertices_.size();
+            overlay_vertices_.push_back(region.vertices[local]);
+        }
+    }
+    overlay_graph_ = Graph(overlay_vertices_.size());
+
+    auto add_overlay_edge = [this](const OverlayEdge& overlay_edge, VertexId from, VertexId to, Weight weight) {
+        overlay_graph_.AddEdge({{}, overlay_id_[from], overlay_id_[to], weight, 0});
+        overlay_edges_.push_back(overlay_edge);
+    };
+
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (region_of_[edge.from] != region_of_[edge.to]) {
+            add_overlay_edge({false, edge_id, 0, 0, 0}, edge.from, edge.to, edge.weight);
+        }
+    }
+    for (size_t region_id = 0; region_id < regions_.size(); ++region_id) {
+        const Region& region = regions_[region_id];
+        for (VertexId from : region.boundary) {
+            for (VertexId to : region.boundary) {
+                if (from == to) {
+                    continue;
+                }
+                if (auto weight = region.router->GetRouteWeight(from, to)) {
+                    add_overlay_edge({true, 0, region_id, from, to}, region.vertices[from], region.vertices[to], *weight);
+                }
+            }
+        }
+    }
+    if (RouteTable table = tables ? tables(regions_.size(), overlay_graph_) : nullptr) {
+        overlay_router_.emplace(overlay_graph_, table);
+    } else {
+        overlay_router_.emplace(overlay_graph_);
+    }
+}
+
+template <typename Weight>
+std::vector<typename PartitionedRouter<Weight>::Leg> PartitionedRouter<Weight>::LegsFrom(VertexId from) const {
+    const Region& region = regions_[region_of_[from]];
+    std::vector<Leg> legs;
+    for (VertexId boundary : region.boundary) {
+        if (auto weight = region.router->GetRouteWeight(local_id_[from], boundary)) {
+            legs.push_back({boundary, *weight});
+        }
+    }
+    return legs;
+}
+
+template <typename Weight>
+std::vector<typename PartitionedRouter<Weight>::Leg> PartitionedRouter<Weight>::LegsTo(VertexId to) const {
+    const Region& region = regions_[region_of_[to]];
+    std::vector<Leg> legs;
+    for (VertexId boundary : region.boundary) {
+        if (auto weight = region.router->GetRouteWeight(boundary, local_id_[to])) {
+            legs.push_back({boundary, *weight});
+        }
+    }
+    return legs;
+}
+
+template <typename Weight>
+void PartitionedRouter<Weight>::AppendLocalRoute(const Region& region, VertexId from, VertexId to,
+                                                 std::vector<EdgeId>& edges) const {
+    const auto route = region.router->BuildRoute(from, to);
+    for (EdgeId local_edge : route->edges) {
+        edges.push_back(region.edges[local_edge]);
+    }
+}
+
+template <typename Weight>
+std::optional<typename PartitionedRouter<Weight>::RouteInfo> PartitionedRouter<Weight>::BuildRoute(VertexId from,
+                                                                                                   VertexId to) const {
+    const Region& region_from = regions_.at(region_of_.at(from));
+    const Region& region_to = regions_.at(region_of_.at(to));
+
+    std::optional<Weight> best;
+    if (&region_from == &region_to) {
+        best = region_from.router->GetRouteWeight(local_id_[from], local_id_[to]);
+    }
+
+    std::vector<Leg> legs_from;
+    std::vector<Leg> legs_to;
+    if (region_from.boundary.size() + region_to.boundary.size() >= PARALLEL_LEG_THRESHOLD) {
+        auto legs_to_future = std::async(std::launch::async, [this, to] { return LegsTo(to); });
+        legs_from = LegsFrom(from);
+        legs_to = legs_to_future.get();
+    } else {
+        legs_from = LegsFrom(from);
+        legs_to = LegsTo(to);
+    }
+
+    std::optional<Leg> best_from;
+    std::optional<Leg> best_to;
+    for (const Leg& leg_from : legs_from) {
+        const VertexId overlay_from = overlay_id_[region_from.vertices[leg_from.boundary]];
+        for (const Leg& leg_to : legs_to) {
+            const VertexId overlay_to = overlay_id_[region_to.vertices[leg_to.boundary]];
+            if (auto middle = overlay_router_->GetRouteWeight(overlay_from, overlay_to)) {
+                const Weight candidate = leg_from.weight + *middle + leg_to.weight;
+                if (!best || candidate < *best) {
+                    best = candidate;
+                    best_from = leg_from;
+                    best_to = leg_to;
+                }
+            }
+        }
+    }
+
+    if (!best) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    if (!best_from) {
+        AppendLocalRoute(region_from, local_id_[from], local_id_[to], edges);
+        return RouteInfo{*best, std::move(edges)};
+    }
+
+    AppendLocalRoute(region_from, local_id_[from], best_from->boundary, edges);
+    const auto overlay_route = overlay_router_->BuildRoute(overlay_id_[region_from.vertices[best_from->boundary]],
+                                                           overlay_id_[region_to.vertices[best_to->boundary]]);
+    for (EdgeId overlay_edge_id : overlay_route->edges) {
+        const OverlayEdge& overlay_edge = overlay_edges_[overlay_edge_id];
+        if (overlay_edge.is_shortcut) {
+            AppendLocalRoute(regions_[overlay_edge.region], overlay_edge.from, overlay_edge.to, edges);
+        } else {
+            edges.push_back(overlay_edge.edge);
+        }
+    }
+    AppendLocalRoute(region_to, best_to->boundary, local_id_[to], edges);
+
+    return RouteInfo{*best, std::move(edges)};
+}
+
+template <typename Weight>
+size_t PartitionedRouter<Weight>::GetMemoryUsage() const {
+    size_t bytes = overlay_router_->GetMemoryUsage()
+                   + overlay_graph_.GetEdgeCount() * (sizeof(Edge<Weight>) + sizeof(OverlayEdge) + sizeof(EdgeId));
+    for (const Region& region : regions_) {
+        bytes += region.router->GetMemoryUsage()
+                 + region.graph.GetEdgeCount() * (sizeof(Edge<Weight>) + 2 * sizeof(EdgeId));
+    }
+    return bytes;
+}
+
+}  // namespace graph
@@ -1,8 +1,17 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <string>
 #include <algorithm>
 #include <set>
+#include <functional>
+#include <future>
+#include <limits>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <numeric>
 #include "geo.h"
 #include "json.h"
@@ -10,7 +19,10 @@
 #include "transport_catalogue.h"
 #include "domain.h"
 #include "transport_router.h"
+#include <unordered_map>
 #include <unordered_set>
+#include <sstream>
+#include <thread>
 
 
 namespace transport_catalogue {
@@ -22,40 +34,138 @@ namespace transport_catalogue {
         double curvature;
     };
 
+    using BusStats = std::unordered_map<std::string_view, BusStat>;
+
+    // Значение, которое вычисляется при первом обращении и затем разделяется всеми
+    // потоками. Готовое значение можно передать в конструкторе
+    template <typename T>
+    class Lazy {
+    public:
+        explicit Lazy(std::function<std::shared_ptr<const T>()> make)
+            : make_(std::move(make)) {
+        }
+
+        explicit Lazy(std::shared_ptr<const T> value) {
+            std::call_once(once_, [&] {
+                value_ = std::move(value);
+                ready_ = value_.get();
+            });
+        }
+
+        const T& Get() const {
+            std::call_once(once_, [this] {
+                value_ = make_();
+                make_ = nullptr;
+                ready_.store(value_.get(), std::memory_order_release);
+            });
+            return *value_;
+        }
+
+        // Значение, если оно уже вычислено, иначе nullptr. Вычисления не ждёт
+        const T* TryGet() const {
+            return ready_.load(std::memory_order_acquire);
+        }
+
+    private:
+        mutable std::once_flag once_;
+        mutable std::function<std::shared_ptr<const T>()> make_;
+        mutable std::shared_ptr<const T> value_;
+        mutable std::atomic<const T*> ready_{ nullptr };
+    };
+
+    // Память на время ответа на один запрос. Первые килобайты берутся из буфера
+    // внутри объекта, остальное — блоками из кучи; Reset освобождает всё сразу,
+    // и следующий запрос снова начинает с буфера
+    class RequestArena {
+    public:
+        RequestArena() = default;
+        RequestArena(const RequestArena&) = delete;
+        RequestArena& operator=(const RequestArena&) = delete;
+
+        std::pmr::memory_resource* Get() {
+            return &resource_;
+        }
+
+        void Reset() {
+            resource_.release();
+        }
+
+    private:
+        std::array<std::byte, 16 * 1024> buffer_;
+        std::pmr::monotonic_buffer_resource resource_{ buffer_.data(), buffer_.size() };
+    };
+
+    // Ответ на запрос Map: карта в SVG вместе с готовой строкой JSON
+    using RenderedMap = json::PreparedString;
+
+    using LazyBusStats = Lazy<BusStats>;
+    using LazyMap = Lazy<RenderedMap>;
+
     class RequestHandler {
     public:
 
-        RequestHandler(const catalogue::TransportCatalogue& db, const renderer::MapRenderer& renderer, TransportRouter& tr) :db_(db), renderer_(renderer), tr_(tr) {}
+        // bus_stats и map — необязательные общие для всех запросов ответы на запросы Bus и Map,
+        // tiles — необязательный кеш плиток для запросов MapTile, route_maps — необязательная
+        // подготовленная к запросам RouteMap карта
+        RequestHandler(const catalogue::TransportCatalogue& db, const renderer::MapRenderer& renderer, const TransportRouter& tr,
+            const LazyBusStats* bus_stats = nullptr, const LazyMap* map = nullptr, const renderer::MapTiles* tiles = nullptr,
+            const renderer::RouteMaps* route_maps = nullptr)
+            :db_(db), renderer_(renderer), tr_(tr), bus_stats_(bus_stats), map_(map), tiles_(tiles), route_maps_(route_maps) {}
 
-        // Возвращает информацию о маршруте (запрос Bus)
-        std::optional<BusStat> GetBusStat(const std::string_view& bus_name) const {
+        // Возвращает информацию о маршруте (запрос Bus). Временные данные расчёта
+        // берутся из resource, например из арены запроса
+        std::optional<BusStat> GetBusStat(const std::string_view& bus_name,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const {
+            if (bus_stats_) {
+                const BusStats& stats = bus_stats_->Get();
+                if (auto it = stats.find(bus_name); it != stats.end()) {
+                    return it->second;
+                }
+                return std::nullopt;
+            }
             const Bus& bus = db_.GetBus(bus_name);
             if (bus.is_exists) {
-                int bus_stops_count = bus.stops.size();
-                std::unordered_set<const Stop*> s(bus.stops.begin(), bus.stops.end());
-                int unique_stops_count = s.size();
-                double route_lenght = std::transform_reduce(bus.stops.begin(), std::prev(bus.stops.end()), std::next(bus.stops.begin()), 0.0, std::plus{},
-                    [](const Stop* s1, const Stop* s2) {return ComputeDistance(s1->coordinates, s2->coordinates); });
-                int real_route_lenght = std::transform_reduce(bus.stops.begin(), std::prev(bus.stops.end()), std::next(bus.stops.begin()), 0.0, std::plus{},
-                    [&](const Stop* s1, const Stop* s2) {return db_.GetDistance(s1, s2); });
-                return { {bus_stops_count, unique_stops_count, real_route_lenght , real_route_lenght / route_lenght} };
-
+                return ComputeBusStat(db_, bus, resource);
             }
             else return {};
         }
 
-        // Возвращает маршруты, проходящие через остановку (запрос Stop)
-        std::optional<std::set<std::string_view>> GetBusesByStop
-        (std::string_view stop_name) const {
+        static BusStat ComputeBusStat(const catalogue::TransportCatalogue& db, const Bus& bus,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+            const BusRoute route = bus.GetRoute();
+            int bus_stops_count = route.size();
+            std::pmr::unordered_set<const Stop*> s(bus.stops.begin(), bus.stops.end(), bus.stops.size(), resource);
+            int unique_stops_count = s.size();
+            double route_lenght = std::transform_reduce(route.begin(), std::prev(route.end()), std::next(route.begin()), 0.0, std::plus{},
+                [](const Stop* s1, const Stop* s2) {return ComputeDistance(s1->coordinates, s2->coordinates); });
+            int real_route_lenght = std::transform_reduce(route.begin(), std::prev(route.end()), std::next(route.begin()), 0.0, std::plus{},
+                [&](const Stop* s1, const Stop* s2) {return db.GetDistance(s1, s2); });
+            return { bus_stops_count, unique_stops_count, real_route_lenght , real_route_lenght / route_lenght };
+        }
+
+        // Статистика всех непустых маршрутов базы
+        static BusStats ComputeAllBusStats(const catalogue::TransportCatalogue& db) {
+            BusStats stats;
+            for (const Bus* bus : db.GetAllBuses()) {
+                stats.emplace(bus->name, ComputeBusStat(db, *bus));
+            }
+            return stats;
+        }
+
+        // Возвращает маршруты, проходящие через остановку (запрос Stop), или nullptr,
+        // если остановки нет. Множество принадлежит справочнику и не копируется
+        const std::set<std::string_view>* GetBusesByStop(std::string_view stop_name) const {
             if (db_.GetStop(stop_name))
-                return { db_.GetBusesForStop(stop_name) };
+                return &db_.GetBusesForStop(stop_name);
             else
-                return std::nullopt;
+                return nullptr;
         }
 
-        std::optional<TransportRouter::RouteInfo> GetRouteInfo(std::string_view from, std::string_view to) const {
+        // Рёбра маршрута размещаются в resource; имена в них ссылаются на справочник
+        std::optional<TransportRouter::RouteInfo> GetRouteInfo(std::string_view from, std::string_view to,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const {
             if (db_.GetStop(from) && db_.GetStop(to)&& tr_.GetExistsVertexId(*db_.GetStop(from))&& tr_.GetExistsVertexId(*db_.GetStop(to))) {
-                return tr_.GetRouteInfo(*tr_.GetExistsVertexId(*db_.GetStop(from)), *tr_.GetExistsVertexId(*db_.GetStop(to)));
+                return tr_.GetRouteInfo(*tr_.GetExistsVertexId(*db_.GetStop(from)), *tr_.GetExistsVertexId(*db_.GetStop(to)), resource);
             }
             else
             {
@@ -65,33 +175,100 @@ namespace transport_catalogue {
 
 
         svg::Document RenderMap() const {
+            return RenderMap(db_, renderer_);
+        }
 
-            std::vector<const Bus*> all_buses = db_.GetAllBuses();
-            std::sort(all_buses.begin(), all_buses.end(), [](const Bus* lhs, const Bus* rhs) { return lhs->name < rhs->name; });
-            std::vector<std::vector<const Stop*>> buses_stops;
-            buses_stops.reserve(all_buses.size());
+        // Возвращает карту (запрос Map). Карта снимка рисуется при первом запросе и не копируется:
+        // указатель на неё ничем не владеет, и память выделяется только при отрисовке
+        std::shared_ptr<const RenderedMap> GetMap() const {
+            if (map_) {
+                return std::shared_ptr<const RenderedMap>(std::shared_ptr<void>(), &map_->Get());
+            }
+            return RenderPreparedMap(db_, renderer_);
+        }
 
-            for (const Bus* bus : all_buses) {
-                buses_stops.push_back(bus->stops);
+        // Возвращает плитку карты (запрос MapTile) или nullptr, если такой плитки нет
+        std::shared_ptr<const RenderedMap> GetMapTile(renderer::TileKey key) const {
+            if (tiles_) {
+                return tiles_->GetTile(key);
             }
+            return renderer::MapTiles(renderer_, db_.GetAllBuses()).GetTile(key);
+        }
 
-            std::vector<geo::Coordinates> stops_coords;
-            for (const auto& stops : buses_stops) {
-                for (const auto& stop : stops) {
-                    stops_coords.push_back(stop->coordinates);
-                }
+        // Возвращает карту с выделенным маршрутом из from в to (запрос RouteMap) или nullptr,
+        // если маршрута нет. Временные данные расчёта маршрута берутся из resource
+        std::shared_ptr<const RenderedMap> GetRouteMap(std::string_view from, std::string_view to,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const {
+            const auto route = GetRouteInfo(from, to, resource);
+            if (!route) {
+                return nullptr;
+            }
+            std::vector<renderer::RouteSpan> spans;
+            spans.reserve(route->edges.size());
+            for (const auto& edge : route->edges) {
+                spans.push_back({ edge.bus, edge.from, edge.to, edge.stops_count });
+            }
+            const auto map = GetMap();
+            if (route_maps_) {
+                return route_maps_->Render(*map, spans);
             }
+            return renderer::RouteMaps(renderer_, db_.GetAllBuses()).Render(*map, spans);
+        }
 
-            const renderer::SphereProjector proj{stops_coords.begin(), stops_coords.end(), renderer_.props.width, renderer_.props.height, renderer_.props.padding};
+        static svg::Document RenderMap(const catalogue::TransportCatalogue& db, const renderer::MapRenderer& renderer) {
+            const renderer::MapRenderer::Scene scene = renderer.MakeScene(db.GetAllBuses());
+            const std::vector<uint32_t> stops = renderer.GetVisibleStops(scene);
 
             svg::Document map;
+            for (const MapPart& part : SplitMap(renderer, scene, stops, std::numeric_limits<size_t>::max())) {
+                part(map);
+            }
+            return map;
+        }
 
-            renderer_.RenderLines(map, buses_stops, proj);
-            renderer_.RenderBusNames(map, all_buses, proj);
-            renderer_.RenderStops(map, all_buses, proj);
-            renderer_.RenderStopNames(map, all_buses, proj);
+        // Рисует слои карты частями по MAP_CHUNK_SIZE элементов в отдельные документы
+        // параллельно и склеивает их в порядке слоёв; результат совпадает с RenderMap
+        static std::string RenderMapSvg(const catalogue::TransportCatalogue& db, const renderer::MapRenderer& renderer) {
+            const renderer::MapRenderer::Scene scene = renderer.MakeScene(db.GetAllBuses());
+            const std::vector<uint32_t> stops = renderer.GetVisibleStops(scene);
+            const std::vector<MapPart> parts = SplitMap(renderer, scene, stops, MAP_CHUNK_SIZE);
 
-            return map;
+            std::vector<std::string> rendered(parts.size());
+            std::atomic<size_t> next_part = 0;
+            auto render_parts = [&] {
+                for (size_t i = next_part++; i < parts.size(); i = next_part++) {
+                    svg::Document map;
+                    parts[i](map);
+                    map.RenderElements(rendered[i]);
+                }
+            };
+            const size_t workers = std::min<size_t>(parts.size(), std::max(1u, std::thread::hardware_concurrency()));
+            std::vector<std::future<void>> futures;
+            for (size_t i = 1; i < workers; ++i) {
+                futures.push_back(std::async(std::launch::async, render_parts));
+            }
+            render_parts();
+            for (auto& future : futures) {
+                future.get();
+            }
+
+            size_t size = 0;
+            for (const std::string& part : rendered) {
+                size += part.size();
+            }
+            std::string svg;
+            svg.reserve(size + 128);
+            svg::Document::BeginSvg(svg);
+            for (const std::string& part : rendered) {
+                svg += part;
+            }
+            svg::Document::EndSvg(svg);
+            return svg;
+        }
+
+        static std::shared_ptr<const RenderedMap> RenderPreparedMap(const catalogue::TransportCatalogue& db,
+            const renderer::MapRenderer& renderer) {
+            return std::make_shared<const RenderedMap>(RenderMapSvg(db, renderer));
         }
 
         std::pair<int, double> GetRoutingSettings() const{
@@ -99,10 +276,44 @@ namespace transport_catalogue {
         }
         
     private:
+        // Часть слоя карты, которая рисуется в переданный документ
+        using MapPart = std::function<void(svg::Document&)>;
+
+        // Сколько элементов слоя рисуется одной частью при параллельной отрисовке
+        static constexpr size_t MAP_CHUNK_SIZE = 512;
+
+        // Части слоёв карты в порядке вывода: линии, названия маршрутов, остановки и их названия
+        static std::vector<MapPart> SplitMap(const renderer::MapRenderer& renderer, const renderer::MapRenderer::Scene& scene,
+            const std::vector<uint32_t>& stops, size_t chunk_size) {
+            std::vector<MapPart> parts;
+            auto add_layer = [&parts, chunk_size](size_t size, auto render) {
+                for (size_t first = 0, last = 0; first < size; first = last) {
+                    last = first + std::min(chunk_size, size - first);
+                    parts.push_back([render, first, last](svg::Document& map) { render(map, first, last); });
+                }
+            };
+            add_layer(scene.buses.size(), [&renderer, &scene](svg::Document& map, size_t first, size_t last) {
+                renderer.RenderLines(map, scene, first, last);
+            });
+            add_layer(scene.buses.size(), [&renderer, &scene](svg::Document& map, size_t first, size_t last) {
+                renderer.RenderBusNames(map, scene, first, last);
+            });
+            add_layer(stops.size(), [&renderer, &scene, &stops](svg::Document& map, size_t first, size_t last) {
+                renderer.RenderStops(map, scene, stops, first, last);
+            });
+            add_layer(stops.size(), [&renderer, &scene, &stops](svg::Document& map, size_t first, size_t last) {
+                renderer.RenderStopNames(map, scene, stops, first, last);
+            });
+            return parts;
+        }
 
         const catalogue::TransportCatalogue& db_;
         const renderer::MapRenderer& renderer_;
         const TransportRouter& tr_;
+        const LazyBusStats* bus_stats_;
+        const LazyMap* map_;
+        const renderer::MapTiles* tiles_;
+        const renderer::RouteMaps* route_maps_;
     };
 }
 
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <stdexcept>
 #include <unordered_map>
@@ -20,8 +21,29 @@ private:
     using Graph = DirectedWeightedGraph<Weight>;
 
 public:
+    // Запись таблицы кратчайших путей. Таблица хранится одним массивом из
+    // vertex_count * vertex_count записей по строкам «откуда», поэтому её можно
+    // сохранить в файл и использовать прямо из отображения файла в память
+    struct RouteInternalData {
+        Weight weight;
+        // Последнее ребро пути: NO_EDGE для пути из вершины в саму себя, UNREACHABLE — если пути нет
+        EdgeId prev_edge;
+    };
+
+    using RouteTable = const RouteInternalData*;
+
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max() - 1;
+    static constexpr EdgeId UNREACHABLE = std::numeric_limits<EdgeId>::max();
+
     explicit Router(const Graph& graph);
 
+    // Таблица уже построена для этого графа; она должна жить дольше маршрутизатора
+    Router(const Graph& graph, RouteTable table);
+
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+    Router(Router&&) = default;
+
     struct RouteInfo {
         Weight weight;
         std::vector<EdgeId> edges;
@@ -29,47 +51,79 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+    // Вес кратчайшего пути без восстановления самого пути
+    std::optional<Weight> GetRouteWeight(VertexId from, VertexId to) const {
+        if (const auto& route_internal_data = At(from, to); IsReachable(route_internal_data)) {
+            return route_internal_data.weight;
+        }
+        return std::nullopt;
+    }
+
+    // Таблица из GetVertexCount() * GetVertexCount() записей
+    RouteTable GetTable() const {
+        return table_;
+    }
+
+    size_t GetVertexCount() const {
+        return vertex_count_;
+    }
+
+    const Graph& GetGraph() const {
+        return graph_;
+    }
+
+    // Приблизительный объём памяти, занятой таблицей кратчайших путей. Готовая таблица
+    // из файла не учитывается: её страницы подгружаются и вытесняются системой
+    size_t GetMemoryUsage() const {
+        return owned_table_.capacity() * sizeof(RouteInternalData);
+    }
+
 private:
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
-    };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    static bool IsReachable(const RouteInternalData& data) {
+        return data.prev_edge != UNREACHABLE;
+    }
+
+    const RouteInternalData& At(VertexId from, VertexId to) const {
+        if (from >= vertex_count_ || to >= vertex_count_) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+        return table_[from * vertex_count_ + to];
+    }
 
     void InitializeRoutesInternalData(const Graph& graph) {
-        const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            owned_table_[vertex * vertex_count_ + vertex] = RouteInternalData{ZERO_WEIGHT, NO_EDGE};
             for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                 const auto& edge = graph.GetEdge(edge_id);
                 if (edge.weight < ZERO_WEIGHT) {
                     throw std::domain_error("Edges' weights should be non-negative");
                 }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
+                auto& route_internal_data = owned_table_[vertex * vertex_count_ + edge.to];
+                if (!IsReachable(route_internal_data) || route_internal_data.weight > edge.weight) {
                     route_internal_data = RouteInternalData{edge.weight, edge_id};
                 }
             }
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
-        }
-    }
-
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-                    }
+    void RelaxRoutesInternalDataThroughVertex(VertexId vertex_through) {
+        const RouteInternalData* const row_through = owned_table_.data() + vertex_through * vertex_count_;
+        for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+            RouteInternalData* const row_from = owned_table_.data() + vertex_from * vertex_count_;
+            const RouteInternalData route_from = row_from[vertex_through];
+            if (!IsReachable(route_from)) {
+                continue;
+            }
+            for (VertexId vertex_to = 0; vertex_to < vertex_count_; ++vertex_to) {
+                const RouteInternalData& route_to = row_through[vertex_to];
+                if (!IsReachable(route_to)) {
+                    continue;
+                }
+                auto& route_relaxing = row_from[vertex_to];
+                const Weight candidate_weight = route_from.weight + route_to.weight;
+                if (!IsReachable(route_relaxing) || candidate_weight < route_relaxing.weight) {
+                    route_relaxing = {candidate_weight,
+                                      route_to.prev_edge != NO_EDGE ? route_to.prev_edge : route_from.prev_edge};
                 }
             }
         }
@@ -77,37 +131,47 @@ private:
 
     static constexpr Weight ZERO_WEIGHT{};
     const Graph& graph_;
-    RoutesInternalData routes_internal_data_;
+    size_t vertex_count_;
+    std::vector<RouteInternalData> owned_table_;
+    const RouteInternalData* table_;
 };
 
 template <typename Weight>
 Router<Weight>::Router(const Graph& graph)
     : graph_(graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+    , vertex_count_(graph.GetVertexCount())
+    , owned_table_(vertex_count_ * vertex_count_, RouteInternalData{ZERO_WEIGHT, UNREACHABLE})
+    , table_(owned_table_.data())
 {
     InitializeRoutesInternalData(graph);
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    for (VertexId vertex_through = 0; vertex_through < vertex_count_; ++vertex_through) {
+        RelaxRoutesInternalDataThroughVertex(vertex_through);
     }
 }
 
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, RouteTable table)
+    : graph_(graph)
+    , vertex_count_(graph.GetVertexCount())
+    , table_(table)
+{
+}
+
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+    const auto& route_internal_data = At(from, to);
+    if (!IsReachable(route_internal_data)) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+    const Weight weight = route_internal_data.weight;
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
+    for (EdgeId edge_id = route_internal_data.prev_edge;
+         edge_id != NO_EDGE;
+         edge_id = At(from, graph_.GetEdge(edge_id).from).prev_edge)
     {
-        edges.push_back(*edge_id);
+        edges.push_back(edge_id);
     }
     std::reverse(edges.begin(), edges.end());
 
@@ -0,0 +1,980 @@
+#include "serialization.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+#include "checksum.h"
+#include "mapped_file.h"
+
+namespace transport_catalogue::serialization {
+
+    using namespace std::literals;
+
+    namespace {
+
+        const char MAGIC[8] = { 'T', 'C', 'B', 'A', 'S', 'E', '\0', '\0' };
+        const char ROUTER_MAGIC[8] = { 'T', 'C', 'R', 'O', 'U', 'T', 'E', '\0' };
+        const char DELTA_MAGIC[8] = { 'T', 'C', 'D', 'E', 'L', 'T', 'A', '\0' };
+        // Записывается как есть: на машине с другим порядком байт читается иначе
+        const uint32_t BYTE_ORDER_MARK = 0x01020304;
+        // Все таблицы начинаются с адреса, кратного этому значению
+        const size_t TABLE_ALIGNMENT = 8;
+
+        const std::string_view BASE_FILE = "base file";
+        const std::string_view CHANGE_LOG = "change log";
+
+        struct Section {
+            uint64_t offset = 0;
+            uint64_t count = 0;
+        };
+
+        // Строка в таблице имён
+        struct StringRecord {
+            uint32_t offset = 0;
+            uint32_t size = 0;
+        };
+
+        struct StopRecord {
+            StringRecord name;
+            double lat = 0;
+            double lng = 0;
+        };
+
+        struct BusRecord {
+            StringRecord name;
+            // Остановки маршрута — отрезок [first_stop, first_stop + stop_count) таблицы bus_stops
+            uint32_t first_stop = 0;
+            uint32_t stop_count = 0;
+            uint32_t is_loop = 0;
+            uint32_t reserved = 0;
+        };
+
+        struct DistanceRecord {
+            uint32_t from = 0;
+            uint32_t to = 0;
+            int32_t distance = 0;
+        };
+
+        struct ColorRecord {
+            // Номер альтернативы svg::Color
+            uint32_t kind = 0;
+            uint8_t red = 0;
+            uint8_t green = 0;
+            uint8_t blue = 0;
+            uint8_t reserved = 0;
+            double opacity = 1;
+            StringRecord name;
+        };
+
+        struct RenderRecord {
+            double width = 0;
+            double height = 0;
+            double padding = 0;
+            double line_width = 0;
+            double stop_radius = 0;
+            int32_t bus_label_font_size = 0;
+            int32_t stop_label_font_size = 0;
+            double bus_label_offset[2] = {};
+            double stop_label_offset[2] = {};
+            double underlayer_width = 0;
+            ColorRecord underlayer_color;
+            double line_tolerance = 0;
+            double stop_cluster_size = 0;
+        };
+
+        struct RoutingRecord {
+            int32_t bus_wait_time = 0;
+            int32_t regions = 1;
+            double bus_velocity = 0;
+        };
+
+        struct Header {
+            char magic[8] = {};
+            uint32_t version = 0;
+            uint32_t byte_order = 0;
+            uint64_t size = 0;
+            // Контрольная сумма файла, посчитанная с нулём на месте этого поля
+            uint64_t checksum = 0;
+            Section names;
+            Section stops;
+            Section buses;
+            Section bus_stops;
+            Section distances;
+            Section palette;
+            // Карта в SVG; пустая, если make_base её не сохранял
+            Section map;
+            RenderRecord render;
+            RoutingRecord routing;
+        };
+
+        // Расстояние в записи журнала; остановки указаны по имени, потому что
+        // новые остановки ещё не имеют номера в файле базы
+        struct DeltaDistanceRecord {
+            StringRecord from;
+            StringRecord to;
+            int32_t distance = 0;
+            uint32_t removed = 0;
+        };
+
+        // Запись журнала изменений: отличия базы от состояния после предыдущей записи.
+        // Остановки и маршруты из stops и buses добавляются или заменяют одноимённые
+        struct DeltaHeader {
+            char magic[8] = {};
+            uint32_t version = 0;
+            uint32_t byte_order = 0;
+            // Размер записи вместе с заголовком, кратный TABLE_ALIGNMENT
+            uint64_t size = 0;
+            uint64_t checksum = 0;
+            // Контрольная сумма файла базы, к которому относится журнал
+            uint64_t base_checksum = 0;
+            Section names;
+            Section stops;
+            Section removed_stops;
+            Section buses;
+            // Имена остановок маршрутов из buses
+            Section bus_stops;
+            Section removed_buses;
+            Section distances;
+        };
+
+        // Файл таблиц маршрутизатора: заголовок, список таблиц, разрезы регионов и сами таблицы
+        struct RouterHeader {
+            char magic[8] = {};
+            uint32_t version = 0;
+            uint32_t byte_order = 0;
+            uint64_t size = 0;
+            // Контрольная сумма базы, для которой построены таблицы
+            uint64_t base_checksum = 0;
+            uint64_t table_count = 0;
+            uint64_t cut_count = 0;
+            // Контрольная сумма заголовка, списка таблиц и разрезов. Сами таблицы не проверяются:
+            // иначе при загрузке пришлось бы прочитать их целиком
+            uint64_t checksum = 0;
+        };
+
+        struct TableRecord {
+            uint64_t offset = 0;
+            uint64_t vertex_count = 0;
+            // Контрольная сумма графа, по которому построена таблица
+            uint64_t graph_checksum = 0;
+        };
+
+        using RouteEntry = graph::Router<double>::RouteInternalData;
+
+        static_assert(sizeof(RouteEntry) == 16 && std::is_trivially_copyable_v<RouteEntry>,
+            "Route table layout is part of the router file format");
+
+        static_assert(std::is_trivially_copyable_v<Header> && std::is_trivially_copyable_v<StopRecord>
+            && std::is_trivially_copyable_v<BusRecord> && std::is_trivially_copyable_v<DistanceRecord>
+            && std::is_trivially_copyable_v<ColorRecord> && std::is_trivially_copyable_v<DeltaHeader>
+            && std::is_trivially_copyable_v<DeltaDistanceRecord>);
+
+        [[noreturn]] void ThrowInvalid(std::string_view file_kind, std::string_view what) {
+            throw std::runtime_error("Invalid "s + std::string(file_kind) + ": "s + std::string(what));
+        }
+
+        // Контрольная сумма файла или записи с нулём на месте поля checksum заголовка
+        template <typename FileHeader>
+        uint64_t ComputeChecksum(std::string_view data) {
+            const size_t field = offsetof(FileHeader, checksum);
+            const uint64_t zero = 0;
+            io::Checksum checksum;
+            checksum.Add(data.data(), field);
+            checksum.Add(&zero, sizeof(zero));
+            checksum.Add(data.data() + field + sizeof(zero), data.size() - field - sizeof(zero));
+            return checksum.Get();
+        }
+
+        // Собирает файл базы (Header) или запись журнала (DeltaHeader)
+        template <typename FileHeader>
+        class FileWriter {
+        public:
+            FileWriter() {
+                data_.resize(sizeof(FileHeader));
+            }
+
+            StringRecord AddString(std::string_view value) {
+                const StringRecord record{ static_cast<uint32_t>(names_.size()), static_cast<uint32_t>(value.size()) };
+                names_.append(value);
+                return record;
+            }
+
+            template <typename T>
+            Section AddTable(const std::vector<T>& table) {
+                Align();
+                const Section section{ data_.size(), table.size() };
+                data_.append(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(T));
+                return section;
+            }
+
+            Section AddTable(std::string_view chars) {
+                Align();
+                const Section section{ data_.size(), chars.size() };
+                data_.append(chars);
+                return section;
+            }
+
+            // Таблица имён записывается последней, когда все строки уже добавлены. Размер
+            // выравнивается, чтобы следующая запись журнала тоже начиналась с выровненного адреса
+            std::string Finish(FileHeader header, const char (&magic)[8]) {
+                Align();
+                header.names = { data_.size(), names_.size() };
+                data_.append(names_);
+                Align();
+                std::memcpy(header.magic, magic, sizeof(header.magic));
+                header.version = FORMAT_VERSION;
+                header.byte_order = BYTE_ORDER_MARK;
+                header.size = data_.size();
+                header.checksum = 0;
+                std::memcpy(data_.data(), &header, sizeof(header));
+                header.checksum = ComputeChecksum<FileHeader>(data_);
+                std::memcpy(data_.data(), &header, sizeof(header));
+                return std::move(data_);
+            }
+
+        private:
+            void Align() {
+                data_.resize((data_.size() + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT, '\0');
+            }
+
+            std::string data_;
+            std::string names_;
+        };
+
+        ColorRecord MakeColorRecord(const svg::Color& color, FileWriter<Header>& writer) {
+            ColorRecord record;
+            record.kind = static_cast<uint32_t>(color.index());
+            if (const auto* name = std::get_if<std::string>(&color)) {
+                record.name = writer.AddString(*name);
+            }
+            else if (const auto* rgb = std::get_if<svg::Rgb>(&color)) {
+                record.red = rgb->red;
+                record.green = rgb->green;
+                record.blue = rgb->blue;
+            }
+            else if (const auto* rgba = std::get_if<svg::Rgba>(&color)) {
+                record.red = rgba->red;
+                record.green = rgba->green;
+                record.blue = rgba->blue;
+                record.opacity = rgba->opacity;
+            }
+            return record;
+        }
+
+        // Таблица файла без копирования
+        template <typename T>
+        class TableView {
+        public:
+            TableView() = default;
+            TableView(const T* items, size_t size) : items_(items), size_(size) {}
+
+            const T* begin() const { return items_; }
+            const T* end() const { return items_ + size_; }
+            size_t size() const { return size_; }
+            const T& operator[](size_t pos) const { return items_[pos]; }
+
+        private:
+            const T* items_ = nullptr;
+            size_t size_ = 0;
+        };
+
+        // Таблицы читаются прямо из данных файла или записи журнала, после проверки границ и выравнивания
+        template <typename FileHeader>
+        class FileReader {
+        public:
+            FileReader(std::string_view data, const char (&magic)[8], std::string_view file_kind)
+                : data_(data)
+                , file_kind_(file_kind) {
+                if (data_.size() < sizeof(FileHeader) || std::memcmp(data_.data(), magic, sizeof(magic)) != 0) {
+                    Throw("bad header"sv);
+                }
+                std::memcpy(&header_, data_.data(), sizeof(FileHeader));
+                if (header_.byte_order != BYTE_ORDER_MARK) {
+                    Throw("byte order mismatch"sv);
+                }
+                if (header_.version != FORMAT_VERSION) {
+                    Throw("format version "s + std::to_string(header_.version) + ", expected "s + std::to_string(FORMAT_VERSION));
+                }
+                if (header_.size != data_.size()) {
+                    Throw("truncated"sv);
+                }
+                const TableView<char> names = Table<char>(header_.names);
+                names_ = { names.begin(), names.size() };
+            }
+
+            const FileHeader& GetHeader() const {
+                return header_;
+            }
+
+            template <typename T>
+            TableView<T> Table(const Section& section) const {
+                if (section.count == 0) {
+                    return {};
+                }
+                if (section.offset > data_.size() || section.count > (data_.size() - section.offset) / sizeof(T)) {
+                    Throw("table out of bounds"sv);
+                }
+                if (reinterpret_cast<uintptr_t>(data_.data() + section.offset) % alignof(T) != 0) {
+                    Throw("misaligned table"sv);
+                }
+                return { reinterpret_cast<const T*>(data_.data() + section.offset), static_cast<size_t>(section.count) };
+            }
+
+            std::string_view String(const StringRecord& record) const {
+                if (record.offset > names_.size() || record.size > names_.size() - record.offset) {
+                    Throw("name out of bounds"sv);
+                }
+                return names_.substr(record.offset, record.size);
+            }
+
+            svg::Color Color(const ColorRecord& record) const {
+                switch (record.kind) {
+                case 0:
+                    return {};
+                case 1:
+                    return std::string(String(record.name));
+                case 2:
+                    return svg::Rgb{ record.red, record.green, record.blue };
+                case 3:
+                    return svg::Rgba{ record.red, record.green, record.blue, record.opacity };
+                default:
+                    Throw("unknown color"sv);
+                }
+            }
+
+            [[noreturn]] void Throw(std::string_view what) const {
+                ThrowInvalid(file_kind_, what);
+            }
+
+        private:
+            std::string_view data_;
+            std::string_view file_kind_;
+            FileHeader header_;
+            std::string_view names_;
+        };
+
+        // Записи журнала по порядку. Недописанная последняя запись — след прерванного
+        // make_base — не читается; size — длина журнала без неё
+        struct ChangeLog {
+            std::vector<std::string_view> records;
+            size_t size = 0;
+        };
+
+        ChangeLog ReadChangeLog(std::string_view data, uint64_t base_checksum) {
+            ChangeLog log;
+            while (data.size() - log.size >= sizeof(DeltaHeader)) {
+                DeltaHeader header;
+                std::memcpy(&header, data.data() + log.size, sizeof(header));
+                if (header.size > data.size() - log.size) {
+                    break;
+                }
+                if (header.size < sizeof(header) || header.size % TABLE_ALIGNMENT != 0) {
+                    ThrowInvalid(CHANGE_LOG, "bad record size"sv);
+                }
+                const std::string_view record = data.substr(log.size, header.size);
+                const FileReader<DeltaHeader> reader(record, DELTA_MAGIC, CHANGE_LOG);
+                if (ComputeChecksum<DeltaHeader>(record) != header.checksum) {
+                    ThrowInvalid(CHANGE_LOG, "checksum mismatch"sv);
+                }
+                if (header.base_checksum != base_checksum) {
+                    ThrowInvalid(CHANGE_LOG, "written for another base file"sv);
+                }
+                log.records.push_back(record);
+                log.size += header.size;
+            }
+            return log;
+        }
+
+        // Итог всех записей журнала: последняя запись об остановке, маршруте или
+        // расстоянии отменяет предыдущие. nullopt означает удаление
+        struct Changes {
+            struct BusChange {
+                bool is_loop = false;
+                std::vector<std::string_view> stops;
+            };
+
+            std::unordered_map<std::string_view, std::optional<geo::Coordinates>> stops;
+            std::unordered_map<std::string_view, std::optional<BusChange>> buses;
+            std::map<std::pair<std::string_view, std::string_view>, std::optional<int>> distances;
+            // Имена в порядке первого появления в журнале: в этом порядке добавляются новые остановки и маршруты
+            std::vector<std::string_view> stop_order;
+            std::vector<std::string_view> bus_order;
+        };
+
+        Changes CollectChanges(const std::vector<std::string_view>& records) {
+            Changes changes;
+            auto set_stop = [&changes](std::string_view name, std::optional<geo::Coordinates> coordinates) {
+                if (auto [it, inserted] = changes.stops.emplace(name, coordinates); !inserted) {
+                    it->second = coordinates;
+                }
+                else {
+                    changes.stop_order.push_back(name);
+                }
+            };
+            auto set_bus = [&changes](std::string_view name, std::optional<Changes::BusChange> bus) {
+                if (auto [it, inserted] = changes.buses.emplace(name, bus); !inserted) {
+                    it->second = std::move(bus);
+                }
+                else {
+                    changes.bus_order.push_back(name);
+                }
+            };
+
+            for (std::string_view record : records) {
+                const FileReader<DeltaHeader> reader(record, DELTA_MAGIC, CHANGE_LOG);
+                const DeltaHeader& header = reader.GetHeader();
+                for (const StringRecord& name : reader.Table<StringRecord>(header.removed_stops)) {
+                    set_stop(reader.String(name), std::nullopt);
+                }
+                for (const StopRecord& stop : reader.Table<StopRecord>(header.stops)) {
+                    set_stop(reader.String(stop.name), geo::Coordinates{ stop.lat, stop.lng });
+                }
+                for (const StringRecord& name : reader.Table<StringRecord>(header.removed_buses)) {
+                    set_bus(reader.String(name), std::nullopt);
+                }
+                const auto bus_stops = reader.Table<StringRecord>(header.bus_stops);
+                for (const BusRecord& bus : reader.Table<BusRecord>(header.buses)) {
+                    if (bus.first_stop > bus_stops.size() || bus.stop_count > bus_stops.size() - bus.first_stop) {
+                        reader.Throw("bus stops out of bounds"sv);
+                    }
+                    Changes::BusChange change{ bus.is_loop != 0, {} };
+                    change.stops.reserve(bus.stop_count);
+                    for (uint32_t i = 0; i < bus.stop_count; ++i) {
+                        change.stops.push_back(reader.String(bus_stops[bus.first_stop + i]));
+                    }
+                    set_bus(reader.String(bus.name), std::move(change));
+                }
+                for (const DeltaDistanceRecord& distance : reader.Table<DeltaDistanceRecord>(header.distances)) {
+                    std::optional<int> value;
+                    if (distance.removed == 0) {
+                        value = distance.distance;
+                    }
+                    changes.distances[{ reader.String(distance.from), reader.String(distance.to) }] = value;
+                }
+            }
+            return changes;
+        }
+
+        // Изменение из Changes; nullptr, если журнал не касался key
+        template <typename Map, typename Key>
+        const typename Map::mapped_type* FindChange(const Map& changes, const Key& key) {
+            if (changes.empty()) {
+                return nullptr;
+            }
+            const auto it = changes.find(key);
+            return it != changes.end() ? &it->second : nullptr;
+        }
+
+        std::optional<io::MappedFile> OpenIfExists(const std::string& file) {
+            if (!std::filesystem::exists(file)) {
+                return std::nullopt;
+            }
+            return io::MappedFile::Open(file);
+        }
+
+        bool HasStoredMap(std::string_view data) {
+            return FileReader<Header>(data, MAGIC, BASE_FILE).GetHeader().map.count != 0;
+        }
+
+        // Файл базы текущей версии, к которому можно дописывать журнал
+        bool IsCurrentBaseFile(std::string_view data) {
+            Header header;
+            if (!IsBaseFile(data) || data.size() < sizeof(header)) {
+                return false;
+            }
+            std::memcpy(&header, data.data(), sizeof(header));
+            return header.byte_order == BYTE_ORDER_MARK && header.version == FORMAT_VERSION;
+        }
+
+    }
+
+    std::string SerializeBase(const catalogue::TransportCatalogue& tc, const renderer::MapRenderer& renderer,
+        const RoutingSettings& routing_settings, std::string_view map) {
+        FileWriter<Header> writer;
+        Header header;
+
+        const std::vector<const Stop*> stops = tc.GetAllStops();
+        std::unordered_map<const Stop*, uint32_t> stop_ids;
+        stop_ids.reserve(stops.size());
+        std::vector<StopRecord> stop_records;
+        stop_records.reserve(stops.size());
+        for (const Stop* stop : stops) {
+            stop_ids.emplace(stop, static_cast<uint32_t>(stop_records.size()));
+            stop_records.push_back({ writer.AddString(stop->name), stop->coordinates.lat, stop->coordinates.lng });
+        }
+        header.stops = writer.AddTable(stop_records);
+
+        std::vector<BusRecord> bus_records;
+        std::vector<uint32_t> bus_stops;
+        for (const Bus* bus : tc.GetAllBuses()) {
+            BusRecord record;
+            record.name = writer.AddString(bus->name);
+            record.first_stop = static_cast<uint32_t>(bus_stops.size());
+            record.stop_count = static_cast<uint32_t>(bus->stops.size());
+            record.is_loop = bus->is_loop ? 1 : 0;
+            for (const Stop* stop : bus->stops) {
+                bus_stops.push_back(stop_ids.at(stop));
+            }
+            bus_records.push_back(record);
+        }
+        header.buses = writer.AddTable(bus_records);
+        header.bus_stops = writer.AddTable(bus_stops);
+
+        // Порядок расстояний в справочнике зависит от хеширования; в файле они упорядочены,
+        // чтобы одна и та же база всегда давала один и тот же файл
+        std::vector<DistanceRecord> distances;
+        tc.ForEachDistance([&](const Stop* from, const Stop* to, int distance) {
+            distances.push_back({ stop_ids.at(from), stop_ids.at(to), distance });
+        });
+        std::sort(distances.begin(), distances.end(), [](const DistanceRecord& lhs, const DistanceRecord& rhs) {
+            return std::pair(lhs.from, lhs.to) < std::pair(rhs.from, rhs.to);
+        });
+        header.distances = writer.AddTable(distances);
+
+        const auto& props = renderer.props;
+        std::vector<ColorRecord> palette;
+        palette.reserve(props.color_palette.size());
+        for (const auto& color : props.color_palette) {
+            palette.push_back(MakeColorRecord(color, writer));
+        }
+        header.palette = writer.AddTable(palette);
+
+        RenderRecord& render = header.render;
+        render.width = props.width;
+        render.height = props.height;
+        render.padding = props.padding;
+        render.line_width = props.line_width;
+        render.stop_radius = props.stop_radius;
+        render.bus_label_font_size = props.bus_label_font_size;
+        render.stop_label_font_size = props.stop_label_font_size;
+        std::copy(props.bus_label_offset.begin(), props.bus_label_offset.end(), render.bus_label_offset);
+        std::copy(props.stop_label_offset.begin(), props.stop_label_offset.end(), render.stop_label_offset);
+        render.underlayer_width = props.underlayer_width;
+        render.underlayer_color = MakeColorRecord(props.underlayer_color, writer);
+        render.line_tolerance = props.line_tolerance;
+        render.stop_cluster_size = props.stop_cluster_size;
+
+        header.routing = { routing_settings.bus_wait_time, routing_settings.regions, routing_settings.bus_velocity };
+        header.map = writer.AddTable(map);
+
+        return writer.Finish(header, MAGIC);
+    }
+
+    void SaveBase(const std::string& file, const catalogue::TransportCatalogue& tc, const renderer::MapRenderer& renderer,
+        const RoutingSettings& routing_settings, std::string_view map) {
+        const std::string data = SerializeBase(tc, renderer, routing_settings, map);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+            throw std::runtime_error("Can't write file " + file);
+        }
+    }
+
+    bool IsBaseFile(std::string_view data) {
+        return data.size() >= sizeof(MAGIC) && data.compare(0, sizeof(MAGIC), std::string_view(MAGIC, sizeof(MAGIC))) == 0;
+    }
+
+    BaseRegistry::LoadedBase ReadBase(std::string_view data, const std::vector<std::string_view>& changes_log) {
+        const FileReader<Header> reader(data, MAGIC, BASE_FILE);
+        const Header& header = reader.GetHeader();
+        const Changes changes = CollectChanges(changes_log);
+        BaseRegistry::LoadedBase base;
+
+        auto add_stop = [&base](std::string_view name, geo::Coordinates coordinates) {
+            base.catalogue.AddStop(Stop{ true, std::string(name), coordinates });
+            return *base.catalogue.GetStop(name);
+        };
+        auto stop_named = [&base](std::string_view name) {
+            if (const auto stop = base.catalogue.GetStop(name)) {
+                return *stop;
+            }
+            ThrowInvalid(CHANGE_LOG, "unknown stop "s + std::string(name));
+        };
+
+        // Остановки и маршруты файла остаются на своих местах, даже если журнал их изменил;
+        // новые добавляются после них. Порядок во входных данных make_base журнал не хранит,
+        // поэтому до свёртки журнала маршрутизатор может выбрать другой из равных по времени
+        // маршрутов, чем у базы, построенной заново
+        const auto stop_records = reader.Table<StopRecord>(header.stops);
+        std::vector<const Stop*> stops;
+        stops.reserve(stop_records.size());
+        for (const StopRecord& record : stop_records) {
+            const std::string_view name = reader.String(record.name);
+            if (const auto* change = FindChange(changes.stops, name)) {
+                stops.push_back(*change ? add_stop(name, **change) : nullptr);
+            }
+            else {
+                stops.push_back(add_stop(name, { record.lat, record.lng }));
+            }
+        }
+        for (std::string_view name : changes.stop_order) {
+            if (const auto& coordinates = changes.stops.at(name); coordinates && !base.catalogue.GetStop(name)) {
+                add_stop(name, *coordinates);
+            }
+        }
+        // nullptr, если остановка удалена журналом
+        auto stop_at = [&stops, &reader](uint32_t id) {
+            if (id >= stops.size()) {
+                reader.Throw("stop id out of range"sv);
+            }
+            return stops[id];
+        };
+
+        auto add_changed_bus = [&](std::string_view name, const Changes::BusChange& change) {
+            Bus bus;
+            bus.name = std::string(name);
+            bus.is_loop = change.is_loop;
+            bus.stops.reserve(change.stops.size());
+            for (std::string_view stop : change.stops) {
+                bus.stops.push_back(stop_named(stop));
+            }
+            base.catalogue.AddBus(std::move(bus));
+        };
+
+        const auto bus_stops = reader.Table<uint32_t>(header.bus_stops);
+        for (const BusRecord& record : reader.Table<BusRecord>(header.buses)) {
+            const std::string_view name = reader.String(record.name);
+            if (const auto* change = FindChange(changes.buses, name)) {
+                if (*change) {
+                    add_changed_bus(name, **change);
+                }
+                continue;
+            }
+            if (record.first_stop > bus_stops.size() || record.stop_count > bus_stops.size() - record.first_stop) {
+                reader.Throw("bus stops out of bounds"sv);
+            }
+            Bus bus;
+            bus.name = std::string(name);
+            bus.is_loop = record.is_loop != 0;
+            bus.stops.reserve(record.stop_count);
+            for (uint32_t i = 0; i < record.stop_count; ++i) {
+                const Stop* stop = stop_at(bus_stops[record.first_stop + i]);
+                if (!stop) {
+                    ThrowInvalid(CHANGE_LOG, "removed stop is used by bus "s + bus.name);
+                }
+                bus.stops.push_back(stop);
+            }
+            base.catalogue.AddBus(std::move(bus));
+        }
+        for (std::string_view name : changes.bus_order) {
+            if (const auto& change = changes.buses.at(name); change && !base.catalogue.GetBus(name).is_exists) {
+                add_changed_bus(name, *change);
+            }
+        }
+
+        for (const DistanceRecord& record : reader.Table<DistanceRecord>(header.distances)) {
+            const Stop* from = stop_at(record.from);
+            const Stop* to = stop_at(record.to);
+            if (from && to && !FindChange(changes.distances, std::pair<std::string_view, std::string_view>(from->name, to->name))) {
+                base.catalogue.SetDistance(from, to, record.distance);
+            }
+        }
+        for (const auto& [stops_pair, distance] : changes.distances) {
+            if (distance) {
+                base.catalogue.SetDistance(stop_named(stops_pair.first), stop_named(stops_pair.second), *distance);
+            }
+        }
+
+        const RenderRecord& render = header.render;
+        auto& props = base.renderer.props;
+        props.width = render.width;
+        props.height = render.height;
+        props.padding = render.padding;
+        props.line_width = render.line_width;
+        props.stop_radius = render.stop_radius;
+        props.bus_label_font_size = render.bus_label_font_size;
+        props.stop_label_font_size = render.stop_label_font_size;
+        std::copy(std::begin(render.bus_label_offset), std::end(render.bus_label_offset), props.bus_label_offset.begin());
+        std::copy(std::begin(render.stop_label_offset), std::end(render.stop_label_offset), props.stop_label_offset.begin());
+        props.underlayer_width = render.underlayer_width;
+        props.underlayer_color = reader.Color(render.underlayer_color);
+        props.line_tolerance = render.line_tolerance;
+        props.stop_cluster_size = render.stop_cluster_size;
+        for (const ColorRecord& color : reader.Table<ColorRecord>(header.palette)) {
+            props.color_palette.push_back(reader.Color(color));
+        }
+
+        base.routing_settings = { header.routing.bus_wait_time, header.routing.bus_velocity, header.routing.regions };
+        // Изменения из журнала делают сохранённую карту устаревшей
+        if (header.map.count != 0 && changes_log.empty()) {
+            const TableView<char> map = reader.Table<char>(header.map);
+            base.map = std::make_shared<const RenderedMap>(std::string(map.begin(), map.size()));
+        }
+        return base;
+    }
+
+    uint64_t GetBaseChecksum(std::string_view data) {
+        return FileReader<Header>(data, MAGIC, BASE_FILE).GetHeader().checksum;
+    }
+
+    std::string GetChangeLogFileName(const std::string& base_file) {
+        return base_file + ".changes";
+    }
+
+    std::string SerializeChanges(const catalogue::TransportCatalogue& previous, const catalogue::TransportCatalogue& current,
+        uint64_t base_checksum) {
+        FileWriter<DeltaHeader> writer;
+        DeltaHeader header;
+        header.base_checksum = base_checksum;
+
+        // Имя остановки встречается во многих маршрутах и расстояниях, а в таблицу имён попадает один раз
+        std::unordered_map<std::string_view, StringRecord> names;
+        auto add_name = [&](std::string_view name) {
+            if (auto it = names.find(name); it != names.end()) {
+                return it->second;
+            }
+            return names.emplace(name, writer.AddString(name)).first->second;
+        };
+
+        std::vector<StopRecord> stops;
+        for (const Stop* stop : current.GetAllStops()) {
+            const auto old = previous.GetStop(stop->name);
+            if (!old || (*old)->coordinates != stop->coordinates) {
+                stops.push_back({ add_name(stop->name), stop->coordinates.lat, stop->coordinates.lng });
+            }
+        }
+        std::vector<StringRecord> removed_stops;
+        for (const Stop* stop : previous.GetAllStops()) {
+            if (!current.GetStop(stop->name)) {
+                removed_stops.push_back(add_name(stop->name));
+            }
+        }
+
+        auto same_stops = [](const Bus& lhs, const Bus& rhs) {
+            return std::equal(lhs.stops.begin(), lhs.stops.end(), rhs.stops.begin(), rhs.stops.end(),
+                [](const Stop* lhs_stop, const Stop* rhs_stop) { return lhs_stop->name == rhs_stop->name; });
+        };
+        std::vector<BusRecord> buses;
+        std::vector<StringRecord> bus_stops;
+        for (const Bus* bus : current.GetAllBuses()) {
+            const Bus& old = previous.GetBus(bus->name);
+            if (old.is_exists && old.is_loop == bus->is_loop && same_stops(old, *bus)) {
+                continue;
+            }
+            BusRecord record;
+            record.name = add_name(bus->name);
+            record.first_stop = static_cast<uint32_t>(bus_stops.size());
+            record.stop_count = static_cast<uint32_t>(bus->stops.size());
+            record.is_loop = bus->is_loop ? 1 : 0;
+            for (const Stop* stop : bus->stops) {
+                bus_stops.push_back(add_name(stop->name));
+            }
+            buses.push_back(record);
+        }
+        // Маршруты без остановок не сохраняются и в файле базы
+        std::vector<StringRecord> removed_buses;
+        for (const Bus* bus : previous.GetAllBuses()) {
+            if (const Bus& now = current.GetBus(bus->name); !now.is_exists || now.stops.empty()) {
+                removed_buses.push_back(add_name(bus->name));
+            }
+        }
+
+        using StopNames = std::pair<std::string_view, std::string_view>;
+        auto distances_of = [](const catalogue::TransportCatalogue& tc) {
+            std::map<StopNames, int> distances;
+            tc.ForEachDistance([&distances](const Stop* from, const Stop* to, int distance) {
+                distances.emplace(StopNames(from->name, to->name), distance);
+            });
+            return distances;
+        };
+        const std::map<StopNames, int> old_distances = distances_of(previous);
+        const std::map<StopNames, int> new_distances = distances_of(current);
+        std::vector<DeltaDistanceRecord> distances;
+        for (const auto& [stops_pair, distance] : new_distances) {
+            if (auto it = old_distances.find(stops_pair); it == old_distances.end() || it->second != distance) {
+                distances.push_back({ add_name(stops_pair.first), add_name(stops_pair.second), distance, 0 });
+            }
+        }
+        for (const auto& [stops_pair, distance] : old_distances) {
+            if (!new_distances.count(stops_pair)) {
+                distances.push_back({ add_name(stops_pair.first), add_name(stops_pair.second), 0, 1 });
+            }
+        }
+
+        if (stops.empty() && removed_stops.empty() && buses.empty() && removed_buses.empty() && distances.empty()) {
+            return {};
+        }
+        header.stops = writer.AddTable(stops);
+        header.removed_stops = writer.AddTable(removed_stops);
+        header.buses = writer.AddTable(buses);
+        header.bus_stops = writer.AddTable(bus_stops);
+        header.removed_buses = writer.AddTable(removed_buses);
+        header.distances = writer.AddTable(distances);
+        return writer.Finish(header, DELTA_MAGIC);
+    }
+
+    namespace {
+        // Настройки отрисовки и маршрутизации в журнал не пишутся: база с другими
+        // настройками сохраняется целиком. Файл пустой базы содержит только настройки
+        std::string SerializeSettings(const renderer::MapRenderer& renderer, const RoutingSettings& routing_settings) {
+            return SerializeBase(catalogue::TransportCatalogue{}, renderer, routing_settings);
+        }
+
+        void AppendChanges(const std::string& file, size_t log_size, const std::string& changes) {
+            // Недописанная запись прерванного make_base отрезается, чтобы новая легла на её место
+            if (std::filesystem::exists(file) && std::filesystem::file_size(file) != log_size) {
+                std::filesystem::resize_file(file, log_size);
+            }
+            std::ofstream out(file, std::ios::binary | std::ios::app);
+            if (!out.write(changes.data(), static_cast<std::streamsize>(changes.size()))) {
+                throw std::runtime_error("Can't write file " + file);
+            }
+        }
+    }
+
+    void MakeBase(const SerializationSettings& settings, const catalogue::TransportCatalogue& tc,
+        const renderer::MapRenderer& renderer, const RoutingSettings& routing_settings) {
+        if (settings.delta) {
+            const std::optional<io::MappedFile> base_file = OpenIfExists(settings.file);
+            if (base_file && IsCurrentBaseFile(base_file->View())) {
+                const uint64_t base_checksum = GetBaseChecksum(base_file->View());
+                const std::string log_file = GetChangeLogFileName(settings.file);
+                const std::optional<io::MappedFile> log_data = OpenIfExists(log_file);
+                const ChangeLog log = log_data ? ReadChangeLog(log_data->View(), base_checksum) : ChangeLog{};
+                const BaseRegistry::LoadedBase previous = ReadBase(base_file->View(), log.records);
+
+                if (SerializeSettings(previous.renderer, previous.routing_settings) == SerializeSettings(renderer, routing_settings)
+                    && HasStoredMap(base_file->View()) == settings.store_map) {
+                    const std::string changes = SerializeChanges(previous.catalogue, tc, base_checksum);
+                    if (changes.empty()) {
+                        return;
+                    }
+                    if (log.records.size() < static_cast<size_t>(std::max(settings.max_changes, 0))) {
+                        AppendChanges(log_file, log.size, changes);
+                        return;
+                    }
+                }
+            }
+        }
+
+        // Журнал сворачивается сохранением tc целиком: его содержимое совпадает с базой и
+        // журналом, а порядок остановок и маршрутов — с порядком во входных данных, как
+        // у базы, построенной заново
+        const std::string map = settings.store_map ? RequestHandler::RenderMapSvg(tc, renderer) : std::string();
+        SaveBase(settings.file, tc, renderer, routing_settings, map);
+        // Журнал удаляется после записи базы: если make_base прервётся между ними,
+        // process_requests откажется читать журнал чужой базы, а не потеряет изменения
+        std::filesystem::remove(GetChangeLogFileName(settings.file));
+        SaveRouterForBase(settings.file);
+    }
+
+    BaseRegistry::LoadedBase LoadBaseFile(const std::string& file) {
+        const io::MappedFile mapped = io::MappedFile::Open(file);
+        const uint64_t base_checksum = GetBaseChecksum(mapped.View());
+        const std::optional<io::MappedFile> log_data = OpenIfExists(GetChangeLogFileName(file));
+        const ChangeLog log = log_data ? ReadChangeLog(log_data->View(), base_checksum) : ChangeLog{};
+        BaseRegistry::LoadedBase base = ReadBase(mapped.View(), log.records);
+        base.routes = LoadRouterFile(GetRouterFileName(file), base_checksum);
+        return base;
+    }
+
+    std::string GetRouterFileName(const std::string& base_file) {
+        return base_file + ".router";
+    }
+
+    namespace {
+        uint64_t ComputeRouterChecksum(RouterHeader header, const std::vector<TableRecord>& tables, const std::vector<double>& cuts) {
+            header.checksum = 0;
+            io::Checksum checksum;
+            checksum.Add(&header, sizeof(header));
+            checksum.Add(tables.data(), tables.size() * sizeof(TableRecord));
+            checksum.Add(cuts.data(), cuts.size() * sizeof(double));
+            return checksum.Get();
+        }
+    }
+
+    void SaveRouter(const std::string& file, const TransportRouter& router, uint64_t base_checksum) {
+        const auto tables = router.GetRouteTables();
+        const std::vector<double>& cuts = router.GetPartitionCuts();
+        RouterHeader header;
+        std::memcpy(header.magic, ROUTER_MAGIC, sizeof(ROUTER_MAGIC));
+        header.version = FORMAT_VERSION;
+        header.byte_order = BYTE_ORDER_MARK;
+        header.base_checksum = base_checksum;
+        header.table_count = tables.size();
+        header.cut_count = cuts.size();
+
+        // Записи таблиц по 16 байт, поэтому после выравнивания начала все таблицы остаются выровненными
+        const size_t directory_size = sizeof(RouterHeader) + tables.size() * sizeof(TableRecord) + cuts.size() * sizeof(double);
+        std::vector<TableRecord> records;
+        uint64_t offset = (directory_size + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+        for (const auto& table : tables) {
+            records.push_back({ offset, table.vertex_count, table.graph_checksum });
+            offset += table.vertex_count * table.vertex_count * sizeof(RouteEntry);
+        }
+        header.size = offset;
+        header.checksum = ComputeRouterChecksum(header, records, cuts);
+
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(TableRecord)));
+        out.write(reinterpret_cast<const char*>(cuts.data()), static_cast<std::streamsize>(cuts.size() * sizeof(double)));
+        const size_t padding = (records.empty() ? header.size : records.front().offset) - directory_size;
+        const char zeros[TABLE_ALIGNMENT] = {};
+        out.write(zeros, static_cast<std::streamsize>(padding));
+        for (const auto& table : tables) {
+            out.write(reinterpret_cast<const char*>(table.table),
+                static_cast<std::streamsize>(table.vertex_count * table.vertex_count * sizeof(RouteEntry)));
+        }
+        if (!out) {
+            throw std::runtime_error("Can't write file " + file);
+        }
+    }
+
+    void SaveRouterForBase(const std::string& base_file) {
+        const io::MappedFile mapped = io::MappedFile::Open(base_file);
+        const BaseRegistry::LoadedBase base = ReadBase(mapped.View());
+        const TransportRouter router(base.catalogue, base.routing_settings);
+        SaveRouter(GetRouterFileName(base_file), router, GetBaseChecksum(mapped.View()));
+    }
+
+    std::shared_ptr<const TransportRouter::PrecomputedRoutes> LoadRouterFile(const std::string& file, uint64_t base_checksum) {
+        if (!std::filesystem::exists(file)) {
+            return nullptr;
+        }
+        auto mapped = std::make_shared<const io::MappedFile>(io::MappedFile::Open(file));
+        const std::string_view data = mapped->View();
+
+        RouterHeader header;
+        if (data.size() < sizeof(header)) {
+            return nullptr;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, ROUTER_MAGIC, sizeof(ROUTER_MAGIC)) != 0 || header.byte_order != BYTE_ORDER_MARK
+            || header.version != FORMAT_VERSION || header.size != data.size() || header.base_checksum != base_checksum
+            || header.table_count > (data.size() - sizeof(header)) / sizeof(TableRecord)
+            || header.cut_count > (data.size() - sizeof(header) - header.table_count * sizeof(TableRecord)) / sizeof(double)) {
+            return nullptr;
+        }
+        std::vector<TableRecord> records(header.table_count);
+        std::memcpy(records.data(), data.data() + sizeof(header), records.size() * sizeof(TableRecord));
+        std::vector<double> cuts(header.cut_count);
+        std::memcpy(cuts.data(), data.data() + sizeof(header) + records.size() * sizeof(TableRecord), cuts.size() * sizeof(double));
+        if (ComputeRouterChecksum(header, records, cuts) != header.checksum) {
+            return nullptr;
+        }
+
+        auto routes = std::make_shared<TransportRouter::PrecomputedRoutes>();
+        routes->partition_cuts = std::move(cuts);
+        for (const TableRecord& record : records) {
+            const uint64_t entries = record.vertex_count * record.vertex_count;
+            if (record.vertex_count > UINT32_MAX || record.offset > data.size()
+                || entries > (data.size() - record.offset) / sizeof(RouteEntry)
+                || reinterpret_cast<uintptr_t>(data.data() + record.offset) % alignof(RouteEntry) != 0) {
+                return nullptr;
+            }
+            routes->tables.push_back({ reinterpret_cast<TransportRouter::RouteTable>(data.data() + record.offset),
+                static_cast<size_t>(record.vertex_count), record.graph_checksum });
+        }
+        routes->storage = std::move(mapped);
+        return routes;
+    }
+
+}
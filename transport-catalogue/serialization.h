@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "base_registry.h"
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+// Двоичный файл базы для стадий make_base и process_requests. Таблицы остановок,
+// маршрутов и расстояний, строки имён и настройки лежат в файле в том же виде,
+// в каком читаются: файл отображается в память, а страницы отображения разделяются
+// процессами, открывшими одну и ту же базу. Справочник собирается из таблиц по
+// индексам, без разбора текста, но владеет копиями имён, поэтому время загрузки
+// растёт с размером базы.
+// Изменения базы можно дописывать в журнал рядом с файлом, не перезаписывая его
+namespace transport_catalogue::serialization {
+
+    // Меняется при любом изменении раскладки файла; файлы другой версии не читаются
+    inline constexpr uint32_t FORMAT_VERSION = 6;
+
+    struct SerializationSettings {
+        // file — файл, в который make_base сохраняет базу и из которого её читает process_requests
+        std::string file;
+        // delta — make_base дописывает в журнал изменений отличия от уже сохранённой базы
+        // вместо того, чтобы сохранять её заново
+        bool delta = false;
+        // max_changes — сколько записей может накопиться в журнале; следующее изменение
+        // make_base сворачивает вместе с журналом в новый файл базы
+        int max_changes = 16;
+        // store_map — make_base рисует карту и сохраняет её в файле базы, чтобы
+        // process_requests не рисовал её заново. Пока журнал изменений пуст,
+        // сохранённая карта совпадает с той, что нарисовал бы process_requests
+        bool store_map = false;
+    };
+
+    // Содержимое файла базы. Маршруты без остановок не сохраняются: на запросы к ним
+    // и так нет ответа. Непустая map сохраняется как готовая карта базы
+    std::string SerializeBase(const catalogue::TransportCatalogue& tc, const renderer::MapRenderer& renderer,
+        const RoutingSettings& routing_settings, std::string_view map = {});
+
+    // Бросает std::runtime_error, если файл не удаётся записать
+    void SaveBase(const std::string& file, const catalogue::TransportCatalogue& tc, const renderer::MapRenderer& renderer,
+        const RoutingSettings& routing_settings, std::string_view map = {});
+
+    // Начинаются ли данные с заголовка файла базы любой версии
+    bool IsBaseFile(std::string_view data);
+
+    // Строит базу по содержимому файла и записям журнала изменений к нему. Сохранённая
+    // карта возвращается, только если журнал пуст. Бросает std::runtime_error,
+    // если версия не совпадает или таблицы выходят за пределы данных
+    BaseRegistry::LoadedBase ReadBase(std::string_view data, const std::vector<std::string_view>& changes = {});
+
+    // Контрольная сумма содержимого файла базы, записанная make_base
+    uint64_t GetBaseChecksum(std::string_view data);
+
+    // Журнал изменений хранится рядом с файлом базы. Каждая запись содержит остановки,
+    // маршруты и расстояния, изменённые или удалённые после предыдущей записи
+    std::string GetChangeLogFileName(const std::string& base_file);
+
+    // Запись журнала с отличиями current от previous; пустая строка, если отличий нет.
+    // Запись применяется только к базе с контрольной суммой base_checksum
+    std::string SerializeChanges(const catalogue::TransportCatalogue& previous, const catalogue::TransportCatalogue& current,
+        uint64_t base_checksum);
+
+    // Стадия make_base. Если включён settings.delta и база уже сохранена с теми же
+    // настройками (включая store_map), дописывает изменения в журнал; иначе, а также когда журнал
+    // достиг settings.max_changes, сохраняет базу и таблицы маршрутизатора целиком.
+    // Бросает std::runtime_error, если файл не удаётся записать
+    void MakeBase(const SerializationSettings& settings, const catalogue::TransportCatalogue& tc,
+        const renderer::MapRenderer& renderer, const RoutingSettings& routing_settings);
+
+    // Загружает базу, применяет к ней журнал изменений и подключает таблицы маршрутизатора
+    // из GetRouterFileName(file). Бросает std::runtime_error, если журнал повреждён или
+    // относится к другой базе
+    BaseRegistry::LoadedBase LoadBaseFile(const std::string& file);
+
+    // Таблицы маршрутизатора хранятся рядом с файлом базы. Их размер квадратичен
+    // по числу остановок, поэтому они отображаются в память, а не читаются
+    std::string GetRouterFileName(const std::string& base_file);
+
+    // Бросает std::runtime_error, если файл не удаётся записать
+    void SaveRouter(const std::string& file, const TransportRouter& router, uint64_t base_checksum);
+
+    // Строит маршрутизатор по сохранённой базе, как его построит process_requests,
+    // и записывает таблицы в GetRouterFileName(base_file)
+    void SaveRouterForBase(const std::string& base_file);
+
+    // nullptr, если файла нет, он повреждён или построен для другой базы. Совпадение
+    // графов проверяет TransportRouter: после изменений из журнала он перестраивает
+    // только таблицы регионов, граф которых изменился
+    std::shared_ptr<const TransportRouter::PrecomputedRoutes> LoadRouterFile(const std::string& file, uint64_t base_checksum);
+
+}
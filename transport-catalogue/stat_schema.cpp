@@ -0,0 +1,111 @@
+#include "stat_schema.h"
+
+#include <iterator>
+
+namespace transport_catalogue::schema {
+
+    using namespace std::literals;
+
+    namespace {
+        template <typename Member>
+        const Member& Require(const StatRequestFields& fields, Member StatRequestFields::* member, std::string_view name) {
+            if (!HasField(fields, member)) {
+                throw std::out_of_range("Field '"s + std::string(name) + "' is missing"s);
+            }
+            return fields.*member;
+        }
+    }
+
+    StatRequestFields ReadStatRequestFields(const json::Node& request) {
+        StatRequestFields fields;
+        for (const auto& [key, value] : request.AsDict()) {
+            json::Node::Value copy = value.GetValue();
+            AssignField(fields, key, std::move(copy));
+        }
+        return fields;
+    }
+
+    std::optional<StatRequest> MakeStatRequest(const StatRequestFields& fields) {
+        const std::string& type = Require(fields, &StatRequestFields::type, "type"sv);
+        if (type == "Bus"sv) {
+            return BusRequest{ Require(fields, &StatRequestFields::id, "id"sv), Require(fields, &StatRequestFields::name, "name"sv) };
+        }
+        if (type == "Stop"sv) {
+            return StopRequest{ Require(fields, &StatRequestFields::id, "id"sv), Require(fields, &StatRequestFields::name, "name"sv) };
+        }
+        if (type == "Map"sv) {
+            return MapRequest{ Require(fields, &StatRequestFields::id, "id"sv) };
+        }
+        if (type == "Route"sv) {
+            return RouteRequest{ Require(fields, &StatRequestFields::id, "id"sv),
+                Require(fields, &StatRequestFields::from, "from"sv), Require(fields, &StatRequestFields::to, "to"sv) };
+        }
+        if (type == "MapTile"sv) {
+            return MapTileRequest{ Require(fields, &StatRequestFields::id, "id"sv), Require(fields, &StatRequestFields::zoom, "zoom"sv),
+                Require(fields, &StatRequestFields::x, "x"sv), Require(fields, &StatRequestFields::y, "y"sv) };
+        }
+        if (type == "RouteMap"sv) {
+            return RouteMapRequest{ Require(fields, &StatRequestFields::id, "id"sv),
+                Require(fields, &StatRequestFields::from, "from"sv), Require(fields, &StatRequestFields::to, "to"sv) };
+        }
+        return std::nullopt;
+    }
+
+    std::string_view GetTypeName(const StatRequest& request) {
+        static constexpr std::string_view names[] = { "Bus"sv, "Stop"sv, "Map"sv, "Route"sv, "MapTile"sv, "RouteMap"sv };
+        static_assert(std::size(names) == std::variant_size_v<StatRequest>);
+        return names[request.index()];
+    }
+
+    // ---------- StatRequestDecoder ------------------
+
+    void StatRequestDecoder::StartDict() {
+        ++depth_;
+    }
+
+    void StatRequestDecoder::Key(std::string&& key) {
+        if (depth_ != 1) {
+            return;
+        }
+        for (const auto& seen : keys_) {
+            if (seen == key) {
+                throw json::ParsingError("Duplicate key '"s + key + "' have been found"s);
+            }
+        }
+        keys_.push_back(key);
+        key_ = std::move(key);
+    }
+
+    void StatRequestDecoder::EndDict() {
+        if (--depth_ == 0) {
+            is_complete_ = true;
+        }
+    }
+
+    void StatRequestDecoder::StartArray() {
+        if (depth_ == 0) {
+            throw std::logic_error("Not a dict");
+        }
+        ++depth_;
+    }
+
+    void StatRequestDecoder::EndArray() {
+        --depth_;
+    }
+
+    void StatRequestDecoder::Value(json::Node::Value&& value) {
+        if (depth_ == 0) {
+            throw std::logic_error("Not a dict");
+        }
+        if (depth_ == 1) {
+            AssignField(fields_, key_, std::move(value));
+        }
+    }
+
+    StatRequestFields StatRequestDecoder::Extract() {
+        is_complete_ = false;
+        keys_.clear();
+        return std::exchange(fields_, StatRequestFields{});
+    }
+
+}  // namespace transport_catalogue::schema
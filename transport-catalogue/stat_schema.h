@@ -0,0 +1,410 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "json.h"
+
+// Типизированные запросы к базе и ответы на них. Для каждой структуры Schema<T>
+// перечисляет поля с их именами в JSON; по этому описанию запросы читаются прямо
+// из событий разбора, а ответы пишутся прямо в json::Writer, без дерева json::Node
+namespace transport_catalogue::schema {
+
+    template <typename Struct, typename T>
+    struct Field {
+        std::string_view name;
+        T Struct::* member;
+    };
+
+    template <typename Struct, typename T>
+    constexpr Field<Struct, T> MakeField(std::string_view name, T Struct::* member) {
+        return { name, member };
+    }
+
+    // Описание полей структуры; определяется специализациями ниже
+    template <typename T>
+    struct Schema;
+
+    template <typename T, typename = void>
+    struct HasSchema : std::false_type {};
+
+    template <typename T>
+    struct HasSchema<T, std::void_t<decltype(Schema<T>::fields)>> : std::true_type {};
+
+    template <typename Fields, size_t... I>
+    constexpr bool AreNamesSorted(const Fields& fields, std::index_sequence<I...>) {
+        return ((std::get<I>(fields).name < std::get<I + 1>(fields).name) && ... && true);
+    }
+
+    // Поля ответа должны идти по возрастанию имён: так же json::Dict упорядочивает ключи при выводе
+    template <typename T>
+    constexpr bool AreFieldsSorted() {
+        constexpr size_t size = std::tuple_size_v<std::decay_t<decltype(Schema<T>::fields)>>;
+        if constexpr (size < 2) {
+            return true;
+        }
+        else {
+            return AreNamesSorted(Schema<T>::fields, std::make_index_sequence<size - 1>{});
+        }
+    }
+
+    template <typename T, typename Func>
+    void ForEachField(Func&& func) {
+        std::apply([&func](const auto&... field) { (func(field), ...); }, Schema<T>::fields);
+    }
+
+    // ---------- Запросы ------------------
+
+    struct BusRequest {
+        int id = 0;
+        std::string name;
+    };
+
+    struct StopRequest {
+        int id = 0;
+        std::string name;
+    };
+
+    struct MapRequest {
+        int id = 0;
+    };
+
+    struct RouteRequest {
+        int id = 0;
+        std::string from;
+        std::string to;
+    };
+
+    struct MapTileRequest {
+        int id = 0;
+        int zoom = 0;
+        int x = 0;
+        int y = 0;
+    };
+
+    struct RouteMapRequest {
+        int id = 0;
+        std::string from;
+        std::string to;
+    };
+
+    using StatRequest = std::variant<BusRequest, StopRequest, MapRequest, RouteRequest, MapTileRequest, RouteMapRequest>;
+
+    // Все поля, которые встречаются в элементах stat_requests; present отмечает прочитанные
+    struct StatRequestFields {
+        std::string base;
+        std::string from;
+        int id = 0;
+        std::string name;
+        std::string to;
+        std::string type;
+        int x = 0;
+        int y = 0;
+        int zoom = 0;
+        uint32_t present = 0;
+    };
+
+    template <>
+    struct Schema<StatRequestFields> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("base", &StatRequestFields::base),
+            MakeField("from", &StatRequestFields::from),
+            MakeField("id", &StatRequestFields::id),
+            MakeField("name", &StatRequestFields::name),
+            MakeField("to", &StatRequestFields::to),
+            MakeField("type", &StatRequestFields::type),
+            MakeField("x", &StatRequestFields::x),
+            MakeField("y", &StatRequestFields::y),
+            MakeField("zoom", &StatRequestFields::zoom));
+    };
+
+    // ---------- Ответы ------------------
+
+    struct BusResponse {
+        double curvature = 0;
+        int request_id = 0;
+        int route_length = 0;
+        int stop_count = 0;
+        int unique_stop_count = 0;
+    };
+
+    // Строки ответов ссылаются на справочник, который отвечает на запрос, а массивы
+    // размещаются в памяти запроса; ответ нужно вывести, пока они живы
+
+    struct StopResponse {
+        std::pmr::vector<std::string_view> buses;
+        int request_id = 0;
+    };
+
+    // Ответ на запросы Map, MapTile и RouteMap
+    struct MapResponse {
+        std::shared_ptr<const json::PreparedString> map;
+        int request_id = 0;
+    };
+
+    struct WaitItem {
+        std::string_view stop_name;
+        int time = 0;
+        std::string_view type = "Wait";
+    };
+
+    struct BusItem {
+        std::string_view bus;
+        int span_count = 0;
+        double time = 0;
+        std::string_view type = "Bus";
+    };
+
+    using RouteItem = std::variant<WaitItem, BusItem>;
+
+    struct RouteResponse {
+        std::pmr::vector<RouteItem> items;
+        int request_id = 0;
+        double total_time = 0;
+    };
+
+    struct ErrorResponse {
+        std::string_view error_message = "not found";
+        int request_id = 0;
+    };
+
+    using StatResponse = std::variant<BusResponse, StopResponse, MapResponse, RouteResponse, ErrorResponse>;
+
+    template <>
+    struct Schema<BusResponse> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("curvature", &BusResponse::curvature),
+            MakeField("request_id", &BusResponse::request_id),
+            MakeField("route_length", &BusResponse::route_length),
+            MakeField("stop_count", &BusResponse::stop_count),
+            MakeField("unique_stop_count", &BusResponse::unique_stop_count));
+    };
+
+    template <>
+    struct Schema<StopResponse> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("buses", &StopResponse::buses),
+            MakeField("request_id", &StopResponse::request_id));
+    };
+
+    template <>
+    struct Schema<MapResponse> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("map", &MapResponse::map),
+            MakeField("request_id", &MapResponse::request_id));
+    };
+
+    template <>
+    struct Schema<WaitItem> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("stop_name", &WaitItem::stop_name),
+            MakeField("time", &WaitItem::time),
+            MakeField("type", &WaitItem::type));
+    };
+
+    template <>
+    struct Schema<BusItem> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("bus", &BusItem::bus),
+            MakeField("span_count", &BusItem::span_count),
+            MakeField("time", &BusItem::time),
+            MakeField("type", &BusItem::type));
+    };
+
+    template <>
+    struct Schema<RouteResponse> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("items", &RouteResponse::items),
+            MakeField("request_id", &RouteResponse::request_id),
+            MakeField("total_time", &RouteResponse::total_time));
+    };
+
+    template <>
+    struct Schema<ErrorResponse> {
+        static constexpr auto fields = std::make_tuple(
+            MakeField("error_message", &ErrorResponse::error_message),
+            MakeField("request_id", &ErrorResponse::request_id));
+    };
+
+    static_assert(AreFieldsSorted<BusResponse>() && AreFieldsSorted<StopResponse>() && AreFieldsSorted<MapResponse>()
+        && AreFieldsSorted<WaitItem>() && AreFieldsSorted<BusItem>() && AreFieldsSorted<RouteResponse>()
+        && AreFieldsSorted<ErrorResponse>());
+
+    // ---------- Запись ответов ------------------
+
+    template <typename T>
+    struct IsVector : std::false_type {};
+
+    template <typename T, typename Allocator>
+    struct IsVector<std::vector<T, Allocator>> : std::true_type {};
+
+    template <typename T>
+    struct IsSharedPtr : std::false_type {};
+
+    template <typename T>
+    struct IsSharedPtr<std::shared_ptr<T>> : std::true_type {};
+
+    template <typename T>
+    struct IsVariant : std::false_type {};
+
+    template <typename... Ts>
+    struct IsVariant<std::variant<Ts...>> : std::true_type {};
+
+    template <typename T>
+    void Write(json::Writer& writer, const T& value) {
+        if constexpr (HasSchema<T>::value) {
+            writer.StartDict();
+            ForEachField<T>([&writer, &value](const auto& field) {
+                writer.Key(field.name);
+                Write(writer, value.*field.member);
+            });
+            writer.EndDict();
+        }
+        else if constexpr (IsVector<T>::value) {
+            writer.StartArray();
+            for (const auto& item : value) {
+                Write(writer, item);
+            }
+            writer.EndArray();
+        }
+        else if constexpr (IsVariant<T>::value) {
+            std::visit([&writer](const auto& alternative) { Write(writer, alternative); }, value);
+        }
+        else if constexpr (IsSharedPtr<T>::value) {
+            Write(writer, *value);
+        }
+        else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            writer.Value(std::string_view(value));
+        }
+        else if constexpr (std::is_same_v<T, json::PreparedString>) {
+            writer.Value(value);
+        }
+        else {
+            writer.Value(value);
+        }
+    }
+
+    // То же значение в виде дерева, для ответов, которые собираются в общий документ
+    template <typename T>
+    json::Node ToNode(const T& value) {
+        if constexpr (HasSchema<T>::value) {
+            json::Dict dict;
+            ForEachField<T>([&dict, &value](const auto& field) {
+                dict.emplace(std::string(field.name), ToNode(value.*field.member));
+            });
+            return json::Node(std::move(dict));
+        }
+        else if constexpr (IsVector<T>::value) {
+            json::Array array;
+            array.reserve(value.size());
+            for (const auto& item : value) {
+                array.push_back(ToNode(item));
+            }
+            return json::Node(std::move(array));
+        }
+        else if constexpr (IsVariant<T>::value) {
+            return std::visit([](const auto& alternative) { return ToNode(alternative); }, value);
+        }
+        else if constexpr (IsSharedPtr<T>::value) {
+            return ToNode(*value);
+        }
+        else if constexpr (std::is_same_v<T, std::string_view>) {
+            return json::Node(std::string(value));
+        }
+        else if constexpr (std::is_same_v<T, json::PreparedString>) {
+            return json::Node(value.Get());
+        }
+        else {
+            return json::Node(value);
+        }
+    }
+
+    // ---------- Чтение запросов ------------------
+
+    // Записывает значение в поле; тип значения проверяется так же, как в json::Node::AsInt и AsString
+    inline void Assign(int& field, json::Node::Value&& value) {
+        if (!std::holds_alternative<int>(value)) {
+            throw std::logic_error("Not an int");
+        }
+        field = std::get<int>(value);
+    }
+
+    inline void Assign(std::string& field, json::Node::Value&& value) {
+        if (!std::holds_alternative<std::string>(value)) {
+            throw std::logic_error("Not a string");
+        }
+        field = std::move(std::get<std::string>(value));
+    }
+
+    // Находит поле по имени и записывает в него значение; неизвестные ключи пропускаются
+    template <typename T>
+    void AssignField(T& target, std::string_view key, json::Node::Value&& value) {
+        uint32_t bit = 1;
+        ForEachField<T>([&](const auto& field) {
+            if (field.name == key) {
+                Assign(target.*field.member, std::move(value));
+                target.present |= bit;
+            }
+            bit <<= 1;
+        });
+    }
+
+    // Было ли поле member прочитано
+    template <typename T, typename Member>
+    bool HasField(const T& target, Member T::* member) {
+        uint32_t bit = 1;
+        bool has_field = false;
+        ForEachField<T>([&](const auto& field) {
+            if constexpr (std::is_same_v<decltype(field.member), Member T::*>) {
+                if (field.member == member) {
+                    has_field = (target.present & bit) != 0;
+                }
+            }
+            bit <<= 1;
+        });
+        return has_field;
+    }
+
+    StatRequestFields ReadStatRequestFields(const json::Node& request);
+
+    // Запрос по типу из поля type; для неизвестного типа — nullopt
+    std::optional<StatRequest> MakeStatRequest(const StatRequestFields& fields);
+
+    // Значение поля type, из которого получен запрос
+    std::string_view GetTypeName(const StatRequest& request);
+
+    // Читает один элемент stat_requests из событий разбора, пропуская неизвестные ключи
+    class StatRequestDecoder final : public json::Handler {
+    public:
+        void StartDict() override;
+        void Key(std::string&& key) override;
+        void EndDict() override;
+        void StartArray() override;
+        void EndArray() override;
+        void Value(json::Node::Value&& value) override;
+
+        bool IsComplete() const {
+            return is_complete_;
+        }
+
+        // Прочитанные поля; декодер готов к следующему элементу
+        StatRequestFields Extract();
+
+    private:
+        StatRequestFields fields_;
+        std::vector<std::string> keys_;
+        std::string key_;
+        // Глубина вложенности; значения глубже полей запроса пропускаются
+        int depth_ = 0;
+        bool is_complete_ = false;
+    };
+
+}  // namespace transport_catalogue::schema
@@ -1,189 +1,281 @@
 #include "svg.h"
 
+#include <charconv>
+
 namespace svg {
 
     using namespace std::literals;
 
-    void Object::Render(const RenderContext& context) const {
-        context.RenderIndent();
+    // Точность std::ostream по умолчанию
+    const int DEFAULT_PRECISION = 6;
 
-        // Делегируем вывод тега своим подклассам
-        RenderObject(context);
+    void AppendNumber(std::string& out, double value) {
+        // %g с точностью 6 — то же, что выводит std::ostream с настройками по умолчанию
+        char buffer[32];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, DEFAULT_PRECISION);
+        out.append(buffer, result.ptr);
+    }
 
-        context.out << std::endl;
+    void AppendNumber(std::string& out, uint32_t value) {
+        char buffer[16];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
     }
 
-    std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap) {
-        using namespace std::literals;
+    void AppendColor(std::string& out, const Color& color) {
+        std::visit(ColorPrinter{ out }, color);
+    }
+
+    namespace {
+
+        // Дописывает текст к out, заменяя спецсимволы XML сущностями
+        void AppendEscaped(std::string& out, std::string_view text) {
+            size_t pos = 0;
+            while (true) {
+                // Участки без спецсимволов копируются целиком
+                const size_t special = text.find_first_of("&\"'`<>"sv, pos);
+                out.append(text.substr(pos, special - pos));
+                if (special == std::string_view::npos) {
+                    break;
+                }
+                switch (text[special]) {
+                case '&':
+                    out += "&amp;"sv;
+                    break;
+                case '"':
+                    out += "&quot;"sv;
+                    break;
+                case '<':
+                    out += "&lt;"sv;
+                    break;
+                case '>':
+                    out += "&gt;"sv;
+                    break;
+                default:
+                    out += "&apos;"sv;
+                    break;
+                }
+                pos = special + 1;
+            }
+        }
+
+        // Отступ элементов внутри тега svg
+        const std::string_view ELEMENT_INDENT = "  "sv;
+
+    }
 
+    std::string_view ToString(StrokeLineCap line_cap) {
         switch (line_cap) {
         case StrokeLineCap::BUTT:
-            out << "butt"sv;
-            break;
+            return "butt"sv;
         case StrokeLineCap::ROUND:
-            out << "round"sv;
-            break;
+            return "round"sv;
         case StrokeLineCap::SQUARE:
-            out << "square"sv;
-            break;
+            return "square"sv;
         }
-        return out;
+        return {};
     }
 
-    std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join) {
-        using namespace std::literals;
-
+    std::string_view ToString(StrokeLineJoin line_join) {
         switch (line_join) {
         case StrokeLineJoin::ARCS:
-            out << "arcs"sv;
-            break;
+            return "arcs"sv;
         case StrokeLineJoin::BEVEL:
-            out << "bevel"sv;
-            break;
+            return "bevel"sv;
         case StrokeLineJoin::MITER:
-            out << "miter"sv;
-            break;
+            return "miter"sv;
         case StrokeLineJoin::MITER_CLIP:
-            out << "miter-clip"sv;
-            break;
+            return "miter-clip"sv;
         case StrokeLineJoin::ROUND:
-            out << "round"sv;
-            break;
+            return "round"sv;
         }
-        return out;
+        return {};
     }
 
-    std::ostream& operator<<(std::ostream& out, Color color) {
-        std::visit(ColorPrinter{ out }, color);
-        return out;
+    std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap) {
+        return out << ToString(line_cap);
     }
 
-    // ---------- Document ----------------
-
-
-    void Document::Render(std::ostream& out) const {
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
-        RenderContext ctx(out, 2, 2);
-        for (auto& obj : objects_) {
-            obj->Render(ctx);
-        }
-        out << "</svg>"sv;
+    std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join) {
+        return out << ToString(line_join);
     }
 
+    std::ostream& operator<<(std::ostream& out, const Color& color) {
+        std::string text;
+        AppendColor(text, color);
+        return out << text;
+    }
 
-    // ---------- Circle ------------------
+    // ---------- Document ----------------
 
-    Circle& Circle::SetCenter(Point center) {
-        center_ = center;
-        return *this;
+    Document::StyleId Document::AddStyle(const PathStyle& style) {
+        StyleRecord record;
+        style.RenderAttrs(record.attrs);
+        return AddStyle(std::move(record));
     }
 
-    Circle& Circle::SetRadius(double radius) {
-        radius_ = radius;
-        return *this;
+    Document::StyleId Document::AddStyle(const TextStyle& style) {
+        StyleRecord record;
+        style.RenderAttrs(record.attrs);
+        style.RenderTextAttrs(record.text_attrs);
+        return AddStyle(std::move(record));
     }
 
-    void Circle::RenderObject(const RenderContext& context) const {
-        auto& out = context.out;
-        out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
-        out << "r=\""sv << radius_ << "\" "sv;
-        RenderAttrs(context.out);
-        out << "/>"sv;
+    Document::StyleId Document::AddStyle(StyleRecord style) {
+        // Атрибуты текста после координат всегда непусты, поэтому стиль текста
+        // не совпадёт со стилем круга или линии с тем же оформлением
+        std::string key = style.attrs + style.text_attrs;
+        const auto [it, inserted] = style_ids_.emplace(std::move(key), static_cast<StyleId>(styles_.size()));
+        if (inserted) {
+            styles_.push_back(std::move(style));
+        }
+        return it->second;
     }
 
+    void Document::AddCircle(Point center, double radius, StyleId style) {
+        elements_.push_back({ ElementKind::CIRCLE, static_cast<uint32_t>(circles_.size()) });
+        circles_.push_back({ center, radius, style });
+    }
 
-    // ------------ Polyline ----------------
-
-    Polyline& Polyline::AddPoint(Point point) {
-        points_.push_back(point);
-        return *this;
+    void Document::AddPolyline(const std::vector<Point>& points, StyleId style) {
+        elements_.push_back({ ElementKind::POLYLINE, static_cast<uint32_t>(polylines_.size()) });
+        polylines_.push_back({ static_cast<uint32_t>(points_.size()), static_cast<uint32_t>(points.size()), style });
+        points_.insert(points_.end(), points.begin(), points.end());
     }
 
-    void Polyline::PrintPoints(std::ostream& out) const {
-        bool first = true;
-        for (const auto& point : points_) {
-            if (first) {
-                out << point.x << ',' << point.y;
-                first = false;
-            }
-            else {
-                out << ' ' << point.x << ',' << point.y;
-            }
+    void Document::AddText(Point position, std::string_view data, StyleId style) {
+        elements_.push_back({ ElementKind::TEXT, static_cast<uint32_t>(texts_.size()) });
+        const size_t offset = text_data_.size();
+        AppendEscaped(text_data_, data);
+        texts_.push_back({ position, static_cast<uint32_t>(offset), static_cast<uint32_t>(text_data_.size() - offset), style });
+    }
 
-        }
+    void Document::Add(const Circle& circle) {
+        StyleRecord style;
+        circle.RenderAttrs(style.attrs);
+        AddCircle(circle.center_, circle.radius_, AddStyle(std::move(style)));
     }
 
-    void Polyline::RenderObject(const RenderContext& context) const {
-        auto& out = context.out;
-        out << "<polyline points=\""sv;
-        PrintPoints(out);
-        out << "\" "sv;
-        RenderAttrs(context.out);
-        out << "/>"sv;
+    void Document::Add(const Polyline& polyline) {
+        StyleRecord style;
+        polyline.RenderAttrs(style.attrs);
+        AddPolyline(polyline.points_, AddStyle(std::move(style)));
     }
 
+    void Document::Add(const Text& text) {
+        StyleRecord style;
+        text.RenderAttrs(style.attrs);
+        text.RenderTextAttrs(style.text_attrs);
+        AddText(text.pos_, text.data_, AddStyle(std::move(style)));
+    }
 
+    void Document::Render(std::ostream& out) const {
+        std::string text;
+        Render(text);
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
 
+    void Document::Render(std::string& out) const {
+        BeginSvg(out);
+        RenderElements(out);
+        EndSvg(out);
+    }
 
+    void Document::BeginSvg(std::string& out) {
+        out += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    }
 
+    void Document::EndSvg(std::string& out) {
+        out += END_TAG;
+    }
 
+    void Document::RenderElements(std::string& out) const {
+        for (const Element& element : elements_) {
+            out += ELEMENT_INDENT;
+            switch (element.kind) {
+            case ElementKind::CIRCLE: {
+                const CircleRecord& circle = circles_[element.index];
+                out += "<circle cx=\""sv;
+                AppendNumber(out, circle.center.x);
+                out += "\" cy=\""sv;
+                AppendNumber(out, circle.center.y);
+                out += "\" r=\""sv;
+                AppendNumber(out, circle.radius);
+                out += "\" "sv;
+                out += styles_[circle.style].attrs;
+                out += "/>"sv;
+                break;
+            }
+            case ElementKind::POLYLINE: {
+                const PolylineRecord& polyline = polylines_[element.index];
+                out += "<polyline points=\""sv;
+                for (uint32_t i = 0; i < polyline.point_count; ++i) {
+                    const Point& point = points_[polyline.first_point + i];
+                    if (i != 0) {
+                        out += ' ';
+                    }
+                    AppendNumber(out, point.x);
+                    out += ',';
+                    AppendNumber(out, point.y);
+                }
+                out += "\" "sv;
+                out += styles_[polyline.style].attrs;
+                out += "/>"sv;
+                break;
+            }
+            case ElementKind::TEXT: {
+                const TextRecord& text = texts_[element.index];
+                const StyleRecord& style = styles_[text.style];
+                out += "<text"sv;
+                out += style.attrs;
+                out += " x=\""sv;
+                AppendNumber(out, text.position.x);
+                out += "\" y=\""sv;
+                AppendNumber(out, text.position.y);
+                out += style.text_attrs;
+                out.append(text_data_, text.data_offset, text.data_size);
+                out += "</text>"sv;
+                break;
+            }
+            }
+            out += '\n';
+        }
+    }
 
 
-    // ------------- Text -------------------
+    // ---------- Circle ------------------
 
-    // Задаёт координаты опорной точки (атрибуты x и y)
-    Text& Text::SetPosition(Point pos) {
-        pos_ = pos;
+    Circle& Circle::SetCenter(Point center) {
+        center_ = center;
         return *this;
     }
 
-    // Задаёт смещение относительно опорной точки (атрибуты dx, dy)
-    Text& Text::SetOffset(Point offset) {
-        offset_ = offset;
+    Circle& Circle::SetRadius(double radius) {
+        radius_ = radius;
         return *this;
     }
 
-    // Задаёт размеры шрифта (атрибут font-size)
-    Text& Text::SetFontSize(uint32_t size) {
-        font_size_ = size;
-        return *this;
-    }
 
-    // Задаёт название шрифта (атрибут font-family)
-    Text& Text::SetFontFamily(std::string font_family) {
-        font_family_ = font_family;
+    // ------------ Polyline ----------------
+
+    Polyline& Polyline::AddPoint(Point point) {
+        points_.push_back(point);
         return *this;
     }
 
-    // Задаёт толщину шрифта (атрибут font-weight)
-    Text& Text::SetFontWeight(std::string font_weight) {
-        font_weight_ = font_weight;
+
+    // ------------- Text -------------------
+
+    // Задаёт координаты опорной точки (атрибуты x и y)
+    Text& Text::SetPosition(Point pos) {
+        pos_ = pos;
         return *this;
     }
 
     // Задаёт текстовое содержимое объекта (отображается внутри тега text)
     Text& Text::SetData(std::string data) {
-        data_ = data;
+        data_ = std::move(data);
         return *this;
     }
-
-    void Text::RenderObject(const RenderContext& context) const {
-        auto& out = context.out;
-        out << "<text";
-        RenderAttrs(context.out);
-        out << " x=\""sv << pos_.x << "\" y=\""sv << pos_.y << "\" dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y
-            << "\" font-size=\""sv << font_size_ << "\"";
-        if (font_family_ != "") {
-            out << " font-family=\""sv << font_family_;
-            out << "\"";
-        }
-        if (font_weight_ != "") {
-            out << " font-weight=\""sv << font_weight_;
-            out << "\"";
-        }
-
-        out << ">"sv;
-        out << Substitute(data_) << "</text>";
-    }
-}  // namespace svg
\ No newline at end of file
+}  // namespace svg
@@ -8,8 +8,8 @@
 #include <vector> 
 #include <algorithm> 
 #include <optional>
+#include <unordered_map>
 #include <variant>
-#include <sstream>
 
 namespace svg {
 
@@ -35,24 +35,42 @@ namespace svg {
     using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
     using namespace std::literals;
 
+    // Дописывает к out число так же, как его вывел бы std::ostream с настройками по умолчанию
+    void AppendNumber(std::string& out, double value);
+    void AppendNumber(std::string& out, uint32_t value);
+
     struct ColorPrinter {
-        std::ostream& out;
+        std::string& out;
         void operator()(std::monostate) const {
-            out << "none"s;
+            out += "none"sv;
         }
-        void operator()(std::string str) const {
-            out << str;
+        void operator()(const std::string& str) const {
+            out += str;
         }
         void operator()(Rgb rgb) const {
-            std::stringstream str;
-            out << "rgb(" << std::to_string(rgb.red) << "," << std::to_string(rgb.green) << "," << std::to_string(rgb.blue) << ")";
-
+            out += "rgb("sv;
+            AppendNumber(out, uint32_t{ rgb.red });
+            out += ',';
+            AppendNumber(out, uint32_t{ rgb.green });
+            out += ',';
+            AppendNumber(out, uint32_t{ rgb.blue });
+            out += ')';
         }
         void operator()(Rgba rgba) const {
-            out << "rgba(" << std::to_string(rgba.red) << "," << std::to_string(rgba.green) << "," << std::to_string(rgba.blue) << "," << rgba.opacity << ")";
+            out += "rgba("sv;
+            AppendNumber(out, uint32_t{ rgba.red });
+            out += ',';
+            AppendNumber(out, uint32_t{ rgba.green });
+            out += ',';
+            AppendNumber(out, uint32_t{ rgba.blue });
+            out += ',';
+            AppendNumber(out, rgba.opacity);
+            out += ')';
         }
     };
 
+    void AppendColor(std::string& out, const Color& color);
+
 
 
     // Объявив в заголовочном файле константу со спецификатором inline,
@@ -75,11 +93,15 @@ namespace svg {
         ROUND,
     };
 
+    std::string_view ToString(StrokeLineCap line_cap);
+
+    std::string_view ToString(StrokeLineJoin line_join);
+
     std::ostream& operator<<(std::ostream& out, StrokeLineCap line_cap);
 
     std::ostream& operator<<(std::ostream& out, StrokeLineJoin line_join);
 
-    std::ostream& operator<<(std::ostream& out, Color color);
+    std::ostream& operator<<(std::ostream& out, const Color& color);
 
     template <typename Owner>
     class PathProps {
@@ -114,23 +136,36 @@ namespace svg {
     protected:
         ~PathProps() = default;
 
-        void RenderAttrs(std::ostream& out) const {
+        // Документ переводит оформление элемента в общую запись стиля
+        friend class Document;
+
+        void RenderAttrs(std::string& out) const {
             using namespace std::literals;
 
             if (fill_color_) {
-                out << " fill=\""sv << *fill_color_ << "\""sv;
+                out += " fill=\""sv;
+                AppendColor(out, *fill_color_);
+                out += '"';
             }
             if (stroke_color_) {
-                out << " stroke=\""sv << *stroke_color_ << "\""sv;
+                out += " stroke=\""sv;
+                AppendColor(out, *stroke_color_);
+                out += '"';
             }
             if (width_) {
-                out << " stroke-width=\""sv << *width_ << "\""sv;
+                out += " stroke-width=\""sv;
+                AppendNumber(out, *width_);
+                out += '"';
             }
             if (line_cap_) {
-                out << " stroke-linecap=\""sv << *line_cap_ << "\""sv;
+                out += " stroke-linecap=\""sv;
+                out += ToString(*line_cap_);
+                out += '"';
             }
             if (line_join_) {
-                out << " stroke-linejoin=\""sv << *line_join_ << "\""sv;
+                out += " stroke-linejoin=\""sv;
+                out += ToString(*line_join_);
+                out += '"';
             }
         }
 
@@ -149,49 +184,6 @@ namespace svg {
     };
 
 
-
-
-
-
-    class Object;
-
-    class ObjectContainer {
-
-    public:
-        template <typename Obj>
-        void Add(Obj obj) {
-            AddPtr(std::make_unique<Obj>(std::move(obj)));
-        }
-
-        virtual ~ObjectContainer() = default;
-
-    private:
-        virtual void AddPtr(std::unique_ptr<Object>&& obj) = 0;
-    };
-
-    class Document final :public ObjectContainer {
-    public:
-        size_t Size() {
-            return objects_.size();
-        }
-
-        // Выводит в ostream svg-представление документа
-        void Render(std::ostream& out) const;
-        //  private:
-        std::vector<std::unique_ptr<Object>> objects_;
-        // Добавляет в svg-документ объект-наследник svg::Object
-        void AddPtr(std::unique_ptr<Object>&& obj) override {
-            objects_.emplace_back(std::move(obj));
-        }
-    };
-
-
-    class Drawable {
-    public:
-        virtual void Draw(ObjectContainer& obj_cont) const = 0;
-        virtual ~Drawable() = default;
-    };
-
     struct Point {
         Point() = default;
         Point(double x, double y)
@@ -202,63 +194,90 @@ namespace svg {
         double y = 0;
     };
 
-    /*
-     * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
-     * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
-     */
-    struct RenderContext {
-        RenderContext(std::ostream& out)
-            : out(out) {
+    // Оформление кругов и ломаных линий, общее для многих элементов документа
+    class PathStyle final : public PathProps<PathStyle> {
+    };
+
+    // Смещение и шрифт текста вместе с оформлением
+    template <typename Owner>
+    class TextProps : public PathProps<Owner> {
+    public:
+        // Задаёт смещение относительно опорной точки (атрибуты dx, dy)
+        Owner& SetOffset(Point offset) {
+            offset_ = offset;
+            return static_cast<Owner&>(*this);
         }
 
-        RenderContext(std::ostream& out, int indent_step, int indent = 0)
-            : out(out)
-            , indent_step(indent_step)
-            , indent(indent) {
+        // Задаёт размеры шрифта (атрибут font-size)
+        Owner& SetFontSize(uint32_t size) {
+            font_size_ = size;
+            return static_cast<Owner&>(*this);
         }
 
-        RenderContext Indented() const {
-            return { out, indent_step, indent + indent_step };
+        // Задаёт название шрифта (атрибут font-family)
+        Owner& SetFontFamily(std::string font_family) {
+            font_family_ = std::move(font_family);
+            return static_cast<Owner&>(*this);
         }
 
-        void RenderIndent() const {
-            for (int i = 0; i < indent; ++i) {
-                out.put(' ');
-            }
+        // Задаёт толщину шрифта (атрибут font-weight)
+        Owner& SetFontWeight(std::string font_weight) {
+            font_weight_ = std::move(font_weight);
+            return static_cast<Owner&>(*this);
         }
 
-        std::ostream& out;
-        int indent_step = 0;
-        int indent = 0;
-    };
+    protected:
+        ~TextProps() = default;
 
-    /*
-     * Абстрактный базовый класс Object служит для унифицированного хранения
-     * конкретных тегов SVG-документа
-     * Реализует паттерн "Шаблонный метод" для вывода содержимого тега
-     */
-    class Object {
-    public:
-        void Render(const RenderContext& context) const;
+        friend class Document;
+
+        // Атрибуты, которые выводятся после координат, вместе с закрывающей скобкой тега
+        void RenderTextAttrs(std::string& out) const {
+            using namespace std::literals;
 
-        virtual ~Object() = default;
+            out += "\" dx=\""sv;
+            AppendNumber(out, offset_.x);
+            out += "\" dy=\""sv;
+            AppendNumber(out, offset_.y);
+            out += "\" font-size=\""sv;
+            AppendNumber(out, font_size_);
+            out += '"';
+            if (!font_family_.empty()) {
+                out += " font-family=\""sv;
+                out += font_family_;
+                out += '"';
+            }
+            if (!font_weight_.empty()) {
+                out += " font-weight=\""sv;
+                out += font_weight_;
+                out += '"';
+            }
+            out += '>';
+        }
 
     private:
-        virtual void RenderObject(const RenderContext& context) const = 0;
+        Point offset_ = { 0,0 };
+        uint32_t font_size_ = 1;
+        std::string font_family_;
+        std::string font_weight_;
+    };
+
+    // Оформление и шрифт текста, общие для многих надписей документа
+    class TextStyle final : public TextProps<TextStyle> {
     };
 
     /*
      * Класс Circle моделирует элемент <circle> для отображения круга
      * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/circle
      */
-    class Circle final : public Object, public PathProps<Circle> {
+    class Circle final : public PathProps<Circle> {
 
     public:
         Circle& SetCenter(Point center);
         Circle& SetRadius(double radius);
 
     private:
-        void RenderObject(const RenderContext& context) const override;
+        friend class Document;
 
         Point center_;
         double radius_ = 1.0;
@@ -268,68 +287,131 @@ namespace svg {
      * Класс Polyline моделирует элемент <polyline> для отображения ломаных линий
      * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/polyline
      */
-    class Polyline final : public Object, public PathProps<Polyline> {
+    class Polyline final : public PathProps<Polyline> {
 
     public:
         // Добавляет очередную вершину к ломаной линии
         Polyline& AddPoint(Point point);
 
     private:
+        friend class Document;
+
         std::vector<Point> points_;
-        void RenderObject(const RenderContext& context) const override;
-        void PrintPoints(std::ostream& out) const;
     };
 
     /*
      * Класс Text моделирует элемент <text> для отображения текста
      * https://developer.mozilla.org/en-US/docs/Web/SVG/Element/text
      */
-    class Text final : public Object, public PathProps<Text> {
+    class Text final : public TextProps<Text> {
     public:
         // Задаёт координаты опорной точки (атрибуты x и y)
         Text& SetPosition(Point pos);
 
-        // Задаёт смещение относительно опорной точки (атрибуты dx, dy)
-        Text& SetOffset(Point offset);
-
-        // Задаёт размеры шрифта (атрибут font-size)
-        Text& SetFontSize(uint32_t size);
-
-        // Задаёт название шрифта (атрибут font-family)
-        Text& SetFontFamily(std::string font_family);
-
-        // Задаёт толщину шрифта (атрибут font-weight)
-        Text& SetFontWeight(std::string font_weight);
-
         // Задаёт текстовое содержимое объекта (отображается внутри тега text)
         Text& SetData(std::string data);
 
     private:
+        friend class Document;
+
         Point pos_ = { 0,0 };
-        Point offset_ = { 0,0 };
-        uint32_t font_size_ = 1;
-        std::string font_family_;
-        std::string font_weight_;
         std::string data_;
+    };
+
+    /*
+     * Документ хранит элементы по видам в отдельных массивах, а не как отдельные объекты
+     * в куче. Оформление элементов сведено в общие записи стилей: элементы с одинаковым
+     * оформлением ссылаются на одну запись, атрибуты которой выведены в текст заранее
+     */
+    class Document final {
+    public:
+        using StyleId = uint32_t;
 
-        std::string Substitute(const std::string& sv) const {
-            std::string res;
-            std::for_each(sv.begin(), sv.end(), [&res](char c) {
-                if (c == '&')
-                    res += "&amp;";
-                else if (c == '"')
-                    res += "&quot;";
-                else if (c == '\'' || c == '`')
-                    res += "&apos;";
-                else if (c == '<')
-                    res += "&lt;";
-                else if (c == '>')
-                    res += "&gt;";
-                else
-                    res += c;
-                });
-            return res;
+        size_t Size() const {
+            return elements_.size();
         }
-        void RenderObject(const RenderContext& context) const override;
+
+        // Возвращает стиль с таким оформлением, добавив его, если такого ещё нет
+        StyleId AddStyle(const PathStyle& style);
+        StyleId AddStyle(const TextStyle& style);
+
+        // Стиль должен быть получен из PathStyle
+        void AddCircle(Point center, double radius, StyleId style);
+        void AddPolyline(const std::vector<Point>& points, StyleId style);
+        // Стиль должен быть получен из TextStyle
+        void AddText(Point position, std::string_view data, StyleId style);
+
+        void Add(const Circle& circle);
+        void Add(const Polyline& polyline);
+        void Add(const Text& text);
+
+        // Выводит в ostream svg-представление документа
+        void Render(std::ostream& out) const;
+
+        // Дописывает svg-представление документа к out
+        void Render(std::string& out) const;
+
+        // Документ можно собрать из частей, заполненных независимо: BeginSvg, затем
+        // RenderElements каждой части по порядку и EndSvg выводят то же, что Render
+        // документа со всеми элементами частей
+        static void BeginSvg(std::string& out);
+        void RenderElements(std::string& out) const;
+        static void EndSvg(std::string& out);
+
+        // Закрывающий тег, которым EndSvg завершает документ
+        static constexpr std::string_view END_TAG = "</svg>";
+
+    private:
+        enum class ElementKind : uint8_t {
+            CIRCLE,
+            POLYLINE,
+            TEXT,
+        };
+
+        // Элемент документа: вид и номер в массиве элементов этого вида
+        struct Element {
+            ElementKind kind;
+            uint32_t index;
+        };
+
+        struct StyleRecord {
+            // Атрибуты оформления; у кругов и линий выводятся после координат, у текста — сразу после имени тега
+            std::string attrs;
+            // Атрибуты текста после координат, вместе с закрывающей скобкой тега
+            std::string text_attrs;
+        };
+
+        struct CircleRecord {
+            Point center;
+            double radius = 0;
+            StyleId style = 0;
+        };
+
+        // Вершины линии — отрезок [first_point, first_point + point_count) массива points_
+        struct PolylineRecord {
+            uint32_t first_point = 0;
+            uint32_t point_count = 0;
+            StyleId style = 0;
+        };
+
+        // Содержимое текста, уже экранированное, — отрезок массива text_data_
+        struct TextRecord {
+            Point position;
+            uint32_t data_offset = 0;
+            uint32_t data_size = 0;
+            StyleId style = 0;
+        };
+
+        StyleId AddStyle(StyleRecord style);
+
+        std::vector<Element> elements_;
+        std::vector<CircleRecord> circles_;
+        std::vector<PolylineRecord> polylines_;
+        std::vector<Point> points_;
+        std::vector<TextRecord> texts_;
+        std::string text_data_;
+        std::vector<StyleRecord> styles_;
+        // Номер стиля по его атрибутам
+        std::unordered_map<std::string, StyleId> style_ids_;
     };
 }  // namespace svg
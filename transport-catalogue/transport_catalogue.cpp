@@ -1,3 +1,4 @@
+
 #include <algorithm>
 #include <optional>
 #include "transport_catalogue.h"
@@ -5,70 +6,127 @@
 namespace transport_catalogue {
     namespace catalogue {
 
+        TransportCatalogue::TransportCatalogue()
+            : stops_(std::make_shared<Stops>())
+            , buses_(std::make_shared<Buses>())
+            , bus_index_(std::make_shared<BusIndex>())
+            , stop_index_(std::make_shared<StopIndex>())
+            , stop_to_buses(std::make_shared<StopToBuses>())
+            , stops_distance(std::make_shared<StopsDistance>()) {
+        }
+
         void TransportCatalogue::AddBus(Bus&& bus) {
-            buses_.push_back(std::move(bus));
-            bus_index_[buses_.back().name] = &buses_.back();
-            for (auto stop : buses_.back().stops) {
-                stop_to_buses[stop->name].insert(buses_.back().name);
+            auto new_bus = std::make_shared<const Bus>(std::move(bus));
+            Buses& buses = Detach(buses_);
+            BusIndex& bus_index = Detach(bus_index_);
+            StopToBuses& buses_for_stop = Detach(stop_to_buses);
+
+            if (auto it = bus_index.find(new_bus->name); it != bus_index.end()) {
+                const Bus* old_bus = it->second;
+                for (auto stop : old_bus->stops) {
+                    buses_for_stop[stop->name].erase(old_bus->name);
+                }
+                bus_index.erase(it);
+                *std::find_if(buses.begin(), buses.end(), [old_bus](const auto& b) { return b.get() == old_bus; }) = new_bus;
+            }
+            else {
+                buses.push_back(new_bus);
+            }
+
+            bus_index[new_bus->name] = new_bus.get();
+            for (auto stop : new_bus->stops) {
+                buses_for_stop[stop->name].insert(new_bus->name);
             }
         }
 
         void TransportCatalogue::AddStop(Stop&& stop) {
-            if (!stop_index_.count(stop.name)) {
-                stops_.push_back(std::move(stop));
-                stop_index_[stops_.back().name] = &stops_.back();
+            if (!stop_index_->count(stop.name)) {
+                Detach(stops_).push_back(std::make_shared<const Stop>(std::move(stop)));
+                const Stop* added = stops_->back().get();
+                Detach(stop_index_)[added->name] = added;
             }
         }
 
         const Bus& TransportCatalogue::GetBus(std::string_view bus) const {
-            if (bus_index_.count(bus)) {
-                return *(bus_index_.at(bus));
+            if (bus_index_->count(bus)) {
+                return *(bus_index_->at(bus));
             }
             else {
-                static Bus bus_;
-                bus_.is_exists = false;
-                bus_.name = bus;
+                static const Bus bus_ = [] {
+                    Bus missing;
+                    missing.is_exists = false;
+                    return missing;
+                }();
                 return bus_;
             }
         }
 
        
         std::optional<const Stop*> TransportCatalogue::GetStop(std::string_view stop) const {
-            if (stop_index_.count(stop))
-                return stop_index_.at(stop);
+            if (stop_index_->count(stop))
+                return stop_index_->at(stop);
             else
                 return std::nullopt;
         }
 
         std::vector<const Bus*> TransportCatalogue::GetAllBuses() const {
             std::vector<const Bus*> res;
-            res.reserve(buses_.size());
-            std::for_each(buses_.begin(), buses_.end(), [&res](const Bus& bus) { if (!bus.stops.empty()) res.push_back(&bus); });
+            res.reserve(buses_->size());
+            std::for_each(buses_->begin(), buses_->end(), [&res](const auto& bus) { if (!bus->stops.empty()) res.push_back(bus.get()); });
 
             return res;
         }
 
+        std::vector<const Stop*> TransportCatalogue::GetAllStops() const {
+            std::vector<const Stop*> res;
+            res.reserve(stops_->size());
+            for (const auto& stop : *stops_) {
+                res.push_back(stop.get());
+            }
+            return res;
+        }
+
 
         const std::set<std::string_view>& TransportCatalogue::GetBusesForStop(std::string_view stop) const {
-            if (stop_to_buses.count(stop))
-                return stop_to_buses.at(stop);
+            if (stop_to_buses->count(stop))
+                return stop_to_buses->at(stop);
             else {
-                static std::set<std::string_view> s;
+                static const std::set<std::string_view> s;
                 return s;
             }
         }
 
 
+        size_t TransportCatalogue::EstimateMemoryUsage() const {
+            // Узел хеш-таблицы или дерева: значение плюс пара указателей служебных данных
+            const size_t node_overhead = 2 * sizeof(void*);
+            size_t bytes = 0;
+            for (const auto& stop : *stops_) {
+                bytes += sizeof(Stop) + stop->name.capacity() + node_overhead;
+            }
+            for (const auto& bus : *buses_) {
+                bytes += sizeof(Bus) + bus->name.capacity() + bus->stops.capacity() * sizeof(const Stop*) + node_overhead;
+            }
+            bytes += (bus_index_->size() + stop_index_->size()) * (sizeof(std::string_view) + sizeof(void*) + node_overhead);
+            for (const auto& [stop, buses] : *stop_to_buses) {
+                bytes += sizeof(std::string_view) + sizeof(std::set<std::string_view>) + node_overhead
+                    + buses.size() * (sizeof(std::string_view) + 3 * sizeof(void*));
+            }
+            bytes += stops_distance->size() * (sizeof(StopsDistance::value_type) + node_overhead);
+            return bytes;
+        }
+
+
         void TransportCatalogue::SetDistance(const Stop* s1, const Stop* s2, int distance) {
-            stops_distance[{s1, s2}] = distance;
+            Detach(stops_distance)[{s1, s2}] = distance;
         }
 
         int TransportCatalogue::GetDistance(const Stop* s1, const Stop* s2) const {
-            if (stops_distance.count({ s1, s2 })) {
-                return stops_distance.at({ s1, s2 });
+            if (stops_distance->count({ s1, s2 })) {
+                return stops_distance->at({ s1, s2 });
             }
-            else if (stops_distance.count({ s2, s1 })) {
-                return stops_distance.at({ s2, s1 });
+            else if (stops_distance->count({ s2, s1 })) {
+                return stops_distance->at({ s2, s1 });
             }
             else {
                 return 0;
@@ -79,5 +137,3 @@ namespace transport_catalogue {
 
     }
 }
-
-
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <deque>
+#include <memory>
 #include <optional>
 #include <vector>
 #include <set>
@@ -12,9 +12,15 @@ namespace transport_catalogue {
     namespace catalogue{
         using namespace geo;
 
+        // Копия справочника разделяет с оригиналом остановки, автобусы и все таблицы.
+        // Таблица копируется только при первом изменении, поэтому версии базы,
+        // отличающиеся парой маршрутов, почти не занимают дополнительной памяти
         class TransportCatalogue {
 
             public:
+            TransportCatalogue();
+
+            // Добавляет маршрут; маршрут с тем же именем заменяется
             void AddBus(Bus&& bus);
 
             void AddStop(Stop&& stop);
@@ -31,28 +37,56 @@ namespace transport_catalogue {
 
             std::vector<const Bus*> GetAllBuses() const;
 
+            // Все остановки в порядке добавления
+            std::vector<const Stop*> GetAllStops() const;
 
+            // Вызывает func(from, to, distance) для каждого заданного расстояния
+            template <typename Func>
+            void ForEachDistance(Func&& func) const {
+                for (const auto& [stops, distance] : *stops_distance) {
+                    func(stops.first, stops.second, distance);
+                }
+            }
 
-            private:
+            // Приблизительный объём памяти, занятой справочником без учёта разделения с другими версиями
+            size_t EstimateMemoryUsage() const;
 
 
-            std::deque<Stop> stops_;
-            std::deque<Bus> buses_;
 
-            std::unordered_map<std::string_view, const Bus*> bus_index_;
-            std::unordered_map<std::string_view, const Stop*> stop_index_;
+            private:
 
-            std::unordered_map<std::string_view, std::set<std::string_view>> stop_to_buses;
-            
             struct StopDistanceHasher {
                 size_t operator()(const std::pair<const Stop*, const Stop*>& p) const {
                     return hasher(p.first) + hasher(p.second) * 17;
                 }
                 std::hash<const void*> hasher;
             };            
-            std::unordered_map<std::pair<const Stop*, const Stop*>, int, StopDistanceHasher> stops_distance;                       
+
+            using Stops = std::vector<std::shared_ptr<const Stop>>;
+            using Buses = std::vector<std::shared_ptr<const Bus>>;
+            using BusIndex = std::unordered_map<std::string_view, const Bus*>;
+            using StopIndex = std::unordered_map<std::string_view, const Stop*>;
+            using StopToBuses = std::unordered_map<std::string_view, std::set<std::string_view>>;
+            using StopsDistance = std::unordered_map<std::pair<const Stop*, const Stop*>, int, StopDistanceHasher>;
+
+            // Возвращает таблицу для изменения, предварительно отделив её от других версий
+            template <typename Table>
+            static Table& Detach(std::shared_ptr<Table>& table) {
+                if (table.use_count() > 1) {
+                    table = std::make_shared<Table>(*table);
+                }
+                return *table;
+            }
+
+            std::shared_ptr<Stops> stops_;
+            std::shared_ptr<Buses> buses_;
+
+            std::shared_ptr<BusIndex> bus_index_;
+            std::shared_ptr<StopIndex> stop_index_;
+
+            std::shared_ptr<StopToBuses> stop_to_buses;
+            
+            std::shared_ptr<StopsDistance> stops_distance;                       
         };            
     }    
 }
-
-
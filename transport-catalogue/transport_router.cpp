@@ -1,6 +1,23 @@
-#include "transport_router.h"  
+#include "transport_router.h"
+#include "checksum.h"
 using namespace transport_catalogue;
 
+namespace {
+    // Таблица кратчайших путей зависит только от вершин и рёбер графа, по которому построена
+    uint64_t ComputeGraphChecksum(const graph::DirectedWeightedGraph<double>& graph) {
+        io::Checksum checksum;
+        checksum.Add(static_cast<uint64_t>(graph.GetVertexCount()));
+        checksum.Add(static_cast<uint64_t>(graph.GetEdgeCount()));
+        for (graph::EdgeId id = 0; id < graph.GetEdgeCount(); ++id) {
+            const auto& edge = graph.GetEdge(id);
+            checksum.Add(static_cast<uint64_t>(edge.from));
+            checksum.Add(static_cast<uint64_t>(edge.to));
+            checksum.Add(edge.weight);
+        }
+        return checksum.Get();
+    }
+}
+
         graph::DirectedWeightedGraph<double> TransportRouter::BuildGraph(const TransportCatalogue& tc) {
 			std::set<const Stop*> unique_stops;
 			for (const auto* bus_ptr : tc.GetAllBuses()) {
@@ -9,34 +26,46 @@ using namespace transport_catalogue;
 
 			graph::DirectedWeightedGraph<double> graph(unique_stops.size());
             
-			auto [wait_time, velocity] = GetRoutingSettings();
-            
 			for (const auto* bus_ptr : tc.GetAllBuses()) {
-				const std::vector<const Stop*>& stops = bus_ptr->stops;
-				for (size_t i = 0, end = stops.size(); i + 1 < end; ++i) {
-
-					const Stop* from = stops[i];
-
-					double edge_weight = wait_time;
-					for (size_t j = i + 1; j < stops.size(); ++j) {
-						const Stop* span_begin = stops[j - 1];
-						const Stop* to = stops[j];
-						edge_weight += tc.GetDistance(span_begin, to) * 60. / (velocity * 1000.);
-						int stops_count = j - i;
-						graph.AddEdge({ bus_ptr->name, GetVertexId(from), GetVertexId(to), edge_weight, stops_count });
-					}
+				// У маршрута без остановок нет рёбер
+				if (bus_ptr->stops.empty()) {
+					continue;
+				}
+				const BusRoute route = bus_ptr->GetRoute();
+				// Рёбра строятся отдельно для каждого направления: поездка через конечную
+				// остановку некольцевого маршрута всегда длиннее пересадки на обратный рейс
+				const size_t turn = bus_ptr->stops.size() - 1;
+				AddBusEdges(graph, tc, bus_ptr->name, route.begin(), route.begin() + turn + 1);
+				if (!bus_ptr->is_loop) {
+					AddBusEdges(graph, tc, bus_ptr->name, route.begin() + turn, route.end());
 				}
 			}
 			return graph;
 		}
 
+        void TransportRouter::AddBusEdges(graph::DirectedWeightedGraph<double>& graph, const TransportCatalogue& tc, const std::string& bus,
+            BusRoute::Iterator begin, BusRoute::Iterator end) {
+			auto [wait_time, velocity] = GetRoutingSettings();
+			for (auto from_it = begin; from_it != end; ++from_it) {
+				const Stop* from = *from_it;
+
+				double edge_weight = wait_time;
+				for (auto to_it = std::next(from_it); to_it != end; ++to_it) {
+					const Stop* span_begin = *std::prev(to_it);
+					const Stop* to = *to_it;
+					edge_weight += tc.GetDistance(span_begin, to) * 60. / (velocity * 1000.);
+					int stops_count = to_it - from_it;
+					graph.AddEdge({ bus, GetVertexId(from), GetVertexId(to), edge_weight, stops_count });
+				}
+			}
+		}
+
 
         VertexId TransportRouter::GetVertexId(const Stop* stop) {
-			static graph::VertexId count = 0;
 			if (!stop_to_vertex_id.count(stop)) {
-				stop_to_vertex_id[stop] = count;
-				id_to_stop[count] = stop;
-				++count;
+				const graph::VertexId id = stop_to_vertex_id.size();
+				stop_to_vertex_id[stop] = id;
+				id_to_stop[id] = stop;
 			}
 			return stop_to_vertex_id[stop];
 		}
@@ -45,16 +74,97 @@ using namespace transport_catalogue;
 			return id_to_stop.at(id);
 		}
 
-        void TransportRouter::SetRoutingSettings(int bus_wait_time, double bus_velocity) {
-           bus_wait_time_ = bus_wait_time;
-           bus_velocity_ = bus_velocity;
-        }
-
         std::pair<int, double> TransportRouter::GetRoutingSettings() const {
-            return { bus_wait_time_, bus_velocity_ };
+            return { settings_.bus_wait_time, settings_.bus_velocity };
         }     
         
-		TransportRouter::TransportRouter(const TransportCatalogue& tc) : graph_(BuildGraph(tc)), router_(graph_) {
+		TransportRouter::TransportRouter(const TransportCatalogue& tc, RoutingSettings settings,
+			std::shared_ptr<const PrecomputedRoutes> routes)
+			: settings_(settings), graph_(BuildGraph(tc)) {
+			auto tables = [this, &routes](size_t index, const graph::DirectedWeightedGraph<double>& graph) -> RouteTable {
+				if (!routes || index >= routes->tables.size()) {
+					return nullptr;
+				}
+				const PrecomputedRoutes::Table& table = routes->tables[index];
+				if (table.vertex_count != graph.GetVertexCount() || table.graph_checksum != ComputeGraphChecksum(graph)) {
+					return nullptr;
+				}
+				++precomputed_tables_;
+				return table.table;
+			};
+
+			const size_t region_count = std::min<size_t>(std::max(settings_.regions, 1), std::max<size_t>(graph_.GetVertexCount(), 1));
+			if (region_count > 1) {
+				const bool has_cuts = routes && routes->partition_cuts.size() == region_count - 1;
+				std::vector<size_t> region_of = PartitionByCoordinates(region_count, has_cuts ? &routes->partition_cuts : nullptr);
+				partitioned_router_.emplace(graph_, std::move(region_of), region_count, tables);
+			}
+			else if (RouteTable table = tables(0, graph_)) {
+				router_.emplace(graph_, table);
+			}
+			else {
+				router_.emplace(graph_);
+			}
+			if (precomputed_tables_ > 0) {
+				routes_storage_ = routes->storage;
+			}
+		}
+
+        std::vector<TransportRouter::PrecomputedRoutes::Table> TransportRouter::GetRouteTables() const {
+			std::vector<const graph::Router<double>*> routers;
+			if (router_) {
+				routers.push_back(&*router_);
+			}
+			else {
+				routers = partitioned_router_->GetRouters();
+			}
+			std::vector<PrecomputedRoutes::Table> tables;
+			for (const auto* router : routers) {
+				tables.push_back({ router->GetTable(), router->GetVertexCount(), ComputeGraphChecksum(router->GetGraph()) });
+			}
+			return tables;
+		}
+
+        std::vector<size_t> TransportRouter::PartitionByCoordinates(size_t region_count, const std::vector<double>* cuts) {
+			std::vector<size_t> region_of(graph_.GetVertexCount(), 0);
+			std::vector<VertexId> vertices;
+			vertices.reserve(id_to_stop.size());
+			for (const auto& [id, stop] : id_to_stop) {
+				vertices.push_back(id);
+			}
+			std::sort(vertices.begin(), vertices.end());
+
+			// Отрезок [begin, end) делится на parts регионов, начиная с региона first_region.
+			// Разрез есть у каждого деления, даже пустого, чтобы сохранённые разрезы читались по порядку
+			partition_cuts_.clear();
+			auto split = [&](auto& self, auto begin, auto end, size_t parts, size_t first_region, bool by_longitude) -> void {
+				if (parts == 1) {
+					std::for_each(begin, end, [&](VertexId id) { region_of[id] = first_region; });
+					return;
+				}
+				auto coordinate = [&](VertexId id) {
+					const auto& coordinates = id_to_stop.at(id)->coordinates;
+					return by_longitude ? coordinates.lng : coordinates.lat;
+				};
+				const size_t left_parts = parts / 2;
+				double cut = 0;
+				if (cuts) {
+					cut = (*cuts)[partition_cuts_.size()];
+				}
+				else if (begin != end) {
+					const auto median = begin + (end - begin) * left_parts / parts;
+					std::nth_element(begin, median, end, [&](VertexId lhs, VertexId rhs) {
+						return coordinate(lhs) < coordinate(rhs);
+					});
+					cut = coordinate(*median);
+				}
+				partition_cuts_.push_back(cut);
+				const auto middle = std::partition(begin, end, [&](VertexId id) { return coordinate(id) < cut; });
+				self(self, begin, middle, left_parts, first_region, !by_longitude);
+				self(self, middle, end, parts - left_parts, first_region + left_parts, !by_longitude);
+			};
+			split(split, vertices.begin(), vertices.end(), region_count, 0, true);
+			return region_of;
 		}
       
         std::optional<VertexId> TransportRouter::GetExistsVertexId(const Stop* stop) const {
@@ -71,14 +181,13 @@ using namespace transport_catalogue;
  
 
 
-		std::optional<TransportRouter::RouteInfo> TransportRouter::GetRouteInfo(VertexId from, VertexId to) const{
-			if (auto info = router_.BuildRoute(from, to)) {
-				RouteInfo rout_info;
-				rout_info.weight = info->weight;
-				rout_info.edges.resize(info->edges.size());
+		std::optional<TransportRouter::RouteInfo> TransportRouter::GetRouteInfo(VertexId from, VertexId to,
+			std::pmr::memory_resource* resource) const{
+			if (auto info = router_ ? router_->BuildRoute(from, to) : partitioned_router_->BuildRoute(from, to)) {
+				RouteInfo rout_info{ info->weight, std::pmr::vector<Edge>(info->edges.size(), resource) };
 
 				std::transform(info->edges.begin(), info->edges.end(), rout_info.edges.begin(), [&](const graph::EdgeId & edge) {
-					auto edge_info = graph_.GetEdge(edge);
+					const auto& edge_info = graph_.GetEdge(edge);
 					TransportRouter::Edge edge_{ edge_info.bus, GetStopByVertexID(edge_info.from)->name, GetStopByVertexID(edge_info.to)->name, edge_info.weight, edge_info.stops_count };
 					return edge_;
 					});
@@ -89,4 +198,14 @@ using namespace transport_catalogue;
 			{
 				return std::nullopt;
 			}
-		}
\ No newline at end of file
+		}
+
+        size_t TransportRouter::EstimateMemoryUsage() const {
+			size_t graph_bytes = graph_.GetEdgeCount() * (sizeof(graph::Edge<double>) + sizeof(graph::EdgeId));
+			for (graph::EdgeId id = 0; id < graph_.GetEdgeCount(); ++id) {
+				graph_bytes += graph_.GetEdge(id).bus.capacity();
+			}
+			const size_t index_bytes = (id_to_stop.size() + stop_to_vertex_id.size()) * 4 * sizeof(void*);
+			const size_t router_bytes = router_ ? router_->GetMemoryUsage() : partitioned_router_->GetMemoryUsage();
+			return graph_bytes + index_bytes + router_bytes;
+		}
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <vector>
 #include <string>
+#include <string_view>
 #include "graph.h"
 #include "router.h"
+#include "partitioned_router.h"
 #include "transport_catalogue.h"
 #include <unordered_map>
 
@@ -12,46 +17,107 @@ namespace transport_catalogue {
 	using namespace transport_catalogue::catalogue;
 	using namespace graph;
 
+    struct RoutingSettings {
+        // bus_wait_time — время ожидания автобуса на остановке, в минутах
+        int bus_wait_time = 0;
+        // bus_velocity — скорость автобуса, в км/ч
+        double bus_velocity = 0;
+        // regions — на сколько регионов по координатам разбивается граф; при значении
+        // больше 1 таблицы маршрутов строятся по регионам вместо одной общей
+        int regions = 1;
+    };
+
 	class TransportRouter {
-        
+    public:
+        using RouteTable = graph::Router<double>::RouteTable;
+
+        // Таблицы кратчайших путей, построенные заранее, например make_base. Таблица
+        // подходит маршрутизатору, только если построена по графу с той же контрольной суммой
+        struct PrecomputedRoutes {
+            struct Table {
+                RouteTable table = nullptr;
+                // Таблица из vertex_count * vertex_count записей
+                size_t vertex_count = 0;
+                uint64_t graph_checksum = 0;
+            };
+
+            // Таблицы в порядке GetRouteTables
+            std::vector<Table> tables;
+            // Разрезы, по которым построены регионы таблиц, в порядке GetPartitionCuts
+            std::vector<double> partition_cuts;
+            // Владелец памяти таблиц, например отображённый в память файл
+            std::shared_ptr<const void> storage;
+        };
+
     private:
-        inline static int bus_wait_time_ = 0 ;
-        inline static double bus_velocity_ = 0;
+        RoutingSettings settings_;
         
         std::unordered_map<graph::VertexId, const Stop*> id_to_stop;
 		std::unordered_map<const void*, graph::VertexId> stop_to_vertex_id;
 		graph::DirectedWeightedGraph<double> graph_;
-		graph::Router<double> router_;
+		std::optional<graph::Router<double>> router_;
+		std::optional<graph::PartitionedRouter<double>> partitioned_router_;
+        // Удерживает память готовых таблиц, если хотя бы одна из них подошла к графу
+        std::shared_ptr<const void> routes_storage_;
+        size_t precomputed_tables_ = 0;
+        std::vector<double> partition_cuts_;
         
         graph::DirectedWeightedGraph<double> BuildGraph(const TransportCatalogue& tc);
+
+        // Делит вершины на регионы примерно равного размера, попеременно разрезая по медиане
+        // долготы и широты. Если cuts заданы, режет по ним: тогда небольшое изменение базы
+        // не сдвигает границы регионов, которых оно не касается
+        std::vector<size_t> PartitionByCoordinates(size_t region_count, const std::vector<double>* cuts);
+
+        void AddBusEdges(graph::DirectedWeightedGraph<double>& graph, const TransportCatalogue& tc, const std::string& bus,
+            BusRoute::Iterator begin, BusRoute::Iterator end);
         
         VertexId GetVertexId(const Stop* stop);
         
         const Stop* GetStopByVertexID(VertexId id) const;
         
     public:        
+        // Имена ссылаются на граф и справочник, по которым построен маршрутизатор
         struct Edge {
-			std::string bus;
-			std::string from;
-			std::string to;
+			std::string_view bus;
+			std::string_view from;
+			std::string_view to;
 			double weight;
 			int stops_count;
 		};
 
 		struct RouteInfo {
 			double weight;
-			std::vector<Edge> edges;		
+			std::pmr::vector<Edge> edges;
 		};
         
-        static void SetRoutingSettings(int bus_wait_time, double bus_velocity);
-
         std::pair<int, double> GetRoutingSettings() const;
         
-		explicit TransportRouter(const TransportCatalogue& tc);
+		// Подходящие к графу таблицы из routes берутся готовыми, остальные строятся заново.
+		// При разбиении на регионы изменение базы перестраивает только затронутые регионы
+		TransportRouter(const TransportCatalogue& tc, RoutingSettings settings,
+			std::shared_ptr<const PrecomputedRoutes> routes = nullptr);
+
+        // Сколько таблиц взято из routes, переданных в конструктор
+        size_t GetPrecomputedTableCount() const {
+            return precomputed_tables_;
+        }
+
+        // Таблицы всех маршрутизаторов: одна общая или по таблице на регион и таблица надстройки
+        std::vector<PrecomputedRoutes::Table> GetRouteTables() const;
+
+        // Координаты разрезов при разбиении на регионы, в порядке обхода дерева разрезов
+        const std::vector<double>& GetPartitionCuts() const {
+            return partition_cuts_;
+        }
       
         std::optional<VertexId> GetExistsVertexId(const Stop* stop) const;
 
-		std::optional<RouteInfo> GetRouteInfo(VertexId from, VertexId to) const;
+		std::optional<RouteInfo> GetRouteInfo(VertexId from, VertexId to,
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+        // Приблизительный объём памяти, занятой графом и таблицей маршрутов
+        size_t EstimateMemoryUsage() const;
 
 	};
 }
\ No newline at end of file